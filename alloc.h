@@ -0,0 +1,54 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : alloc.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef alloc_h
+#define alloc_h
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitio.h"
+#include "lz77.h"
+
+/***************************************************************************
+ *                         MEMORY ALLOC FUNCTIONS
+ * Name         : memAlloc, memCalloc, memFree - malloc, calloc and free
+ *                through the allocator of the caller (see lz77_alloc), or
+ *                the C library's without one
+ * Parameters   : a - the allocator, NULL for none
+ *                size - # of bytes
+ *                ptr - memory to give back, NULL for none
+ * Returned     : the memory, NULL if there is none
+ ***************************************************************************/
+static inline void *memAlloc(const struct lz77_alloc *a, size_t size)
+{
+    return (a != NULL) ? a->alloc(a->opaque, size) : malloc(size);
+}
+
+static inline void *memCalloc(const struct lz77_alloc *a, size_t size)
+{
+    void *ptr;
+    
+    /* calloc gets the pages of the large areas zeroed by the system */
+    if (a == NULL)
+        return calloc(1, size);
+    if ((ptr = a->alloc(a->opaque, size)) != NULL)
+        memset(ptr, 0, size);
+    
+    return ptr;
+}
+
+static inline void memFree(const struct lz77_alloc *a, void *ptr)
+{
+    if (a == NULL)
+        free(ptr);
+    else if (ptr != NULL)
+        a->free(a->opaque, ptr);
+}
+#endif
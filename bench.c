@@ -0,0 +1,553 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : bench.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ *                              DESCRIPTION
+ *
+ *   Benchmark of the codec, linked directly with it: every corpus is
+ *   compressed and decompressed in memory with every pair of lookahead and
+ *   search buffer sizes of the grid, at each level given, and the round
+ *   trip is checked. The corpora are generated here (random, zeros,
+ *   English-like text, log lines and binary records, always the same
+ *   bytes) or read from the files given on the command line.
+ *
+ *   Each run is done in a child process, so that its peak RSS is its own.
+ *   The results are printed as a table and written in JSON, to compare a
+ *   change with a baseline. With -c, a configuration which compresses to
+ *   more at a level (from the one given on) than at a lower one fails as
+ *   well.
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "getopt.h"
+#include "bitio.h"
+#include "lz77.h"
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define DEFAULT_SIZE (4 << 20)  /* size of the generated corpora */
+#define DEFAULT_REPEAT 3        /* runs of each configuration, the best is kept */
+#define MAX_GRID 16             /* max # of sizes in each list of the grid */
+#define MAX_CORPORA 64          /* max # of corpora */
+#define BENCH_JSON "bench.json" /* default JSON output */
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ ***************************************************************************/
+struct corpus{
+    const char *name;           /* generated corpus or file name */
+    void (*gen)(unsigned char *, size_t);   /* generator, NULL for a file */
+    unsigned char *data;
+    size_t size;
+};
+
+/* what a child reports of its run */
+struct result{
+    size_t csize;               /* compressed size */
+    double ctime, dtime;        /* best compression and decompression time */
+    int ok;                     /* the round trip gave back the data */
+};
+
+/***************************************************************************
+ *                          XORSHIFT FUNCTION
+ * Name         : xorshift - pseudo-random numbers, the same on every run
+ * Parameters   : s - state, not 0
+ * Returned     : next number
+ ***************************************************************************/
+static uint32_t xorshift(uint32_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+
+    return *s;
+}
+
+/***************************************************************************
+ *                         GENERATORS FUNCTIONS
+ * Name         : genRandom, genZeros, genText, genLog, genBinary - fill
+ *                the buffer with a corpus
+ * Parameters   : buf - the buffer
+ *                n - its size
+ ***************************************************************************/
+static void genRandom(unsigned char *buf, size_t n)
+{
+    uint32_t s = 0x9E3779B9;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        buf[i] = xorshift(&s) >> 24;
+}
+
+static void genZeros(unsigned char *buf, size_t n)
+{
+    memset(buf, 0, n);
+}
+
+static const char *words[] = {
+    "the", "of", "and", "to", "a", "in", "is", "it", "that", "was", "he",
+    "for", "on", "are", "with", "as", "his", "they", "be", "at", "one",
+    "have", "this", "from", "or", "had", "by", "word", "but", "what", "some",
+    "we", "can", "out", "other", "were", "all", "there", "when", "up", "use",
+    "your", "how", "said", "an", "each", "she", "which", "do", "their",
+    "time", "if", "will", "way", "about", "many", "then", "them", "write",
+    "would", "like", "so", "these", "her", "long", "make", "thing", "see",
+    "him", "two", "has", "look", "more", "day", "could", "go", "come",
+    "did", "number", "sound", "no", "most", "people", "my", "over", "know",
+    "water", "than", "call", "first", "who", "may", "down", "side", "been",
+    "now", "find", "compression", "window", "buffer", "dictionary", "match"
+};
+
+/* English-like: words of skewed frequencies, sentences and paragraphs */
+static void genText(unsigned char *buf, size_t n)
+{
+    uint32_t s = 0x2545F491;
+    size_t i = 0, nw = sizeof(words) / sizeof(words[0]), len;
+    int inSentence = 0, k;
+    const char *w;
+
+    while (i < n){
+        /* the product of two uniform picks favours the first words */
+        k = (xorshift(&s) % nw) * (xorshift(&s) % nw) / nw;
+        w = words[k];
+        len = strlen(w);
+        if (i + len + 2 > n)
+            break;
+        memcpy(&(buf[i]), w, len);
+        if (!inSentence)
+            buf[i] -= 'a' - 'A';
+        i += len;
+        inSentence = 1;
+
+        k = xorshift(&s) % 100;
+        if (k < 8){
+            buf[i++] = '.';
+            inSentence = 0;
+        }else if (k < 12)
+            buf[i++] = ',';
+        buf[i++] = (k == 0) ? '\n' : ' ';
+    }
+    while (i < n)
+        buf[i++] = '\n';
+}
+
+/* log lines: timestamps, levels, hosts and counters */
+static void genLog(unsigned char *buf, size_t n)
+{
+    static const char *levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+    static const char *paths[] = {"/api/v1/items", "/api/v1/users", "/static/app.js", "/health", "/api/v2/orders"};
+    char line[256];
+    uint32_t s = 0x6C078965;
+    size_t i = 0, len;
+    unsigned int t = 0;
+
+    while (i < n){
+        t += xorshift(&s) % 1500;
+        len = snprintf(line, sizeof(line), "2026-10-18 %02u:%02u:%02u.%03u %s [worker-%u] %s id=%u status=%u time=%ums\n",
+                       (t / 3600000) % 24, (t / 60000) % 60, (t / 1000) % 60, t % 1000,
+                       levels[xorshift(&s) % 6], xorshift(&s) % 8, paths[xorshift(&s) % 5],
+                       xorshift(&s) % 100000, (xorshift(&s) % 10) ? 200 : 404, xorshift(&s) % 250);
+        if (len > n - i)
+            len = n - i;
+        memcpy(&(buf[i]), line, len);
+        i += len;
+    }
+}
+
+/* binary: records of little endian counters, small values and padding */
+static void genBinary(unsigned char *buf, size_t n)
+{
+    uint32_t s = 0x12345678, id = 1000, v;
+    size_t i = 0;
+    int j;
+    unsigned char rec[32];
+
+    while (i < n){
+        memset(rec, 0, sizeof(rec));
+        id += 1 + xorshift(&s) % 4;
+        for (j = 0; j < 4; j++)
+            rec[j] = id >> (8 * j);
+        v = xorshift(&s);
+        rec[4] = v % 7;
+        rec[8] = (v >> 8) & 0xFF;
+        rec[9] = (v >> 16) & 0x0F;
+        for (j = 16; j < 16 + (int)(v >> 28); j++)
+            rec[j] = xorshift(&s);
+        memcpy(&(buf[i]), rec, (n - i < sizeof(rec)) ? n - i : sizeof(rec));
+        i += sizeof(rec);
+    }
+}
+
+/***************************************************************************
+ *                         LOAD CORPUS FUNCTION
+ * Name         : loadCorpus - generate a corpus or read its file
+ * Parameters   : c - the corpus
+ *                size - size of a generated corpus
+ * Returned     : 0 on success, -1 on errors
+ ***************************************************************************/
+static int loadCorpus(struct corpus *c, size_t size)
+{
+    FILE *f;
+    long n;
+
+    if (c->gen != NULL){
+        c->size = size;
+        if ((c->data = malloc(size + 1)) == NULL)
+            return -1;
+        c->gen(c->data, size);
+        return 0;
+    }
+
+    if ((f = fopen(c->name, "rb")) == NULL)
+        return -1;
+    if (fseek(f, 0, SEEK_END) < 0 || (n = ftell(f)) < 0){
+        fclose(f);
+        return -1;
+    }
+    rewind(f);
+    c->size = n;
+    if ((c->data = malloc(n + 1)) == NULL || fread(c->data, 1, n, f) != (size_t)n){
+        free(c->data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    return 0;
+}
+
+/***************************************************************************
+ *                            NOW FUNCTION
+ * Name         : now - monotonic time
+ * Returned     : seconds
+ ***************************************************************************/
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/***************************************************************************
+ *                           RUN FUNCTION
+ * Name         : run - compress and decompress a corpus, in the child
+ * Parameters   : c - the corpus
+ *                p - encoder parameters
+ *                repeat - # of runs, the best times are kept
+ *                r - where the result goes
+ ***************************************************************************/
+static void run(const struct corpus *c, const struct lz77_params *p, int repeat, struct result *r)
+{
+    size_t cap = lz77_compress_bound(c->size, p->la, p->sb), dsize = 0;
+    unsigned char *cbuf = malloc(cap), *dbuf = malloc(c->size + 1);
+    double t;
+    int i;
+
+    r->csize = 0;
+    r->ctime = r->dtime = -1;
+    r->ok = 0;
+    if (cbuf == NULL || dbuf == NULL)
+        return;
+
+    for (i = 0; i < repeat; i++){
+        t = now();
+        r->csize = lz77_compress_params(c->data, c->size, cbuf, cap, p);
+        t = now() - t;
+        if (r->csize == LZ77_ERROR)
+            return;
+        if (r->ctime < 0 || t < r->ctime)
+            r->ctime = t;
+
+        t = now();
+        dsize = lz77_decompress(cbuf, r->csize, dbuf, c->size + 1);
+        t = now() - t;
+        if (r->dtime < 0 || t < r->dtime)
+            r->dtime = t;
+    }
+    r->ok = (dsize == c->size && memcmp(dbuf, c->data, c->size) == 0);
+
+    free(cbuf);
+    free(dbuf);
+}
+
+/***************************************************************************
+ *                          FORK RUN FUNCTION
+ * Name         : forkRun - do a run in a child process
+ * Parameters   : c - the corpus
+ *                p - encoder parameters
+ *                repeat - # of runs
+ *                r - where the result goes
+ *                rss - where the peak RSS of the child goes, in KB
+ * Returned     : 0 on success, -1 if the child failed
+ ***************************************************************************/
+static int forkRun(const struct corpus *c, const struct lz77_params *p, int repeat, struct result *r, long *rss)
+{
+    struct rusage ru;
+    int fd[2], status;
+    pid_t pid;
+    ssize_t got;
+
+    if (pipe(fd) < 0 || (pid = fork()) < 0)
+        return -1;
+    if (pid == 0){
+        close(fd[0]);
+        run(c, p, repeat, r);
+        _exit(write(fd[1], r, sizeof(*r)) == sizeof(*r) ? 0 : 1);
+    }
+
+    close(fd[1]);
+    got = read(fd[0], r, sizeof(*r));
+    close(fd[0]);
+    if (wait4(pid, &status, 0, &ru) < 0 || got != sizeof(*r) || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    *rss = ru.ru_maxrss;
+
+    return 0;
+}
+
+/***************************************************************************
+ *                          PARSE LIST FUNCTION
+ * Name         : parseList - read a comma separated list of sizes
+ * Parameters   : arg - the list
+ *                v - where the sizes go, at most MAX_GRID
+ * Returned     : # of sizes, -1 if the list is not valid
+ ***************************************************************************/
+static int parseList(char *arg, int *v)
+{
+    char *tok, *end;
+    int n = 0;
+
+    for (tok = strtok(arg, ","); tok != NULL; tok = strtok(NULL, ",")){
+        if (n == MAX_GRID)
+            return -1;
+        v[n] = strtol(tok, &end, 10);
+        if (end == tok || *end != '\0' || v[n] < 0)
+            return -1;
+        n++;
+    }
+
+    return (n > 0) ? n : -1;
+}
+
+/***************************************************************************
+ *                             MAIN FUNCTION
+ * Syntax: ./lz77bench <options> [files]
+ * Options: -n <bytes> : size of the generated corpora (default 4 MiB)
+ *          -l <list> : lookahead sizes, comma separated (default 15,255)
+ *          -s <list> : search buffer sizes (default 4095,65535)
+ *          -m <finder> : bt, tree or hash (default bt)
+ *          -1 .. -9 : compression level (default 5)
+ *          -L <list> : compression levels, comma separated
+ *          -c <level> : fail if the output of a level from this one on
+ *                       is larger than the one of a lower level
+ *          -e : Huffman code the tokens
+ *          -f <format> : triples or flagged (default triples)
+ *          -r <value> : runs of each configuration, the best is kept
+ *          -j <file> : JSON output (default bench.json, - for stdout)
+ *          -h : help
+ * The files given are benchmarked instead of the generated corpora.
+ ***************************************************************************/
+int main(int argc, char *argv[])
+{
+    /* variables */
+    struct corpus corpora[MAX_CORPORA];
+    int las[MAX_GRID] = {15, 255}, sbs[MAX_GRID] = {4095, 65535}, lvs[MAX_GRID] = {-1};
+    int nla = 2, nsb = 2, nlv = 1, ncorpora = 0, repeat = DEFAULT_REPEAT, check = 0;
+    size_t size = DEFAULT_SIZE;
+    struct lz77_params params;
+    const char *json = BENCH_JSON;
+    const char *finder = "bt";
+    struct result r;
+    size_t prev;
+    FILE *out;
+    long rss;
+    int opt, i, a, b, v, first = 1, failed = 0;
+
+    static const struct corpus gens[] = {
+        {"random", genRandom, NULL, 0}, {"zeros", genZeros, NULL, 0},
+        {"text", genText, NULL, 0}, {"log", genLog, NULL, 0},
+        {"binary", genBinary, NULL, 0}
+    };
+
+    lz77_defaults(&params);
+
+    while ((opt = getopt(argc, argv, "n:l:s:m:ef:r:j:L:c:h123456789")) != -1){
+        switch (opt){
+            case 'n':
+                size = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                if ((nla = parseList(optarg, las)) < 0){
+                    fprintf(stderr, "Bad lookahead sizes.\n");
+                    return 1;
+                }
+                break;
+            case 's':
+                if ((nsb = parseList(optarg, sbs)) < 0){
+                    fprintf(stderr, "Bad search buffer sizes.\n");
+                    return 1;
+                }
+                break;
+            case 'm':
+                finder = optarg;
+                if (strcmp(optarg, "bt") == 0)
+                    params.finder = LZ77_BT;
+                else if (strcmp(optarg, "tree") == 0)
+                    params.finder = LZ77_TREE;
+                else if (strcmp(optarg, "hash") == 0)
+                    params.finder = LZ77_HASH;
+                else{
+                    fprintf(stderr, "Bad match finder.\n");
+                    return 1;
+                }
+                break;
+            case 'e':
+                params.huffman = 1;
+                break;
+            case 'f':
+                if (strcmp(optarg, "triples") == 0)
+                    params.format = LZ77_TRIPLES;
+                else if (strcmp(optarg, "flagged") == 0)
+                    params.format = LZ77_FLAGGED;
+                else{
+                    fprintf(stderr, "Bad token format.\n");
+                    return 1;
+                }
+                break;
+            case 'r':
+                if ((repeat = atoi(optarg)) < 1){
+                    fprintf(stderr, "Bad # of runs.\n");
+                    return 1;
+                }
+                break;
+            case 'j':
+                json = optarg;
+                break;
+            case '1': case '2': case '3': case '4': case '5':
+            case '6': case '7': case '8': case '9':
+                lvs[0] = opt - '0';
+                nlv = 1;
+                break;
+            case 'L':
+                if ((nlv = parseList(optarg, lvs)) < 0){
+                    fprintf(stderr, "Bad compression levels.\n");
+                    return 1;
+                }
+                for (v = 0; v < nlv; v++){
+                    if (lvs[v] < 1 || lvs[v] > 9 || (v > 0 && lvs[v] <= lvs[v - 1])){
+                        fprintf(stderr, "Bad compression levels.\n");
+                        return 1;
+                    }
+                }
+                break;
+            case 'c':
+                check = atoi(optarg);
+                if (check < 1 || check > 9){
+                    fprintf(stderr, "Bad compression level.\n");
+                    return 1;
+                }
+                break;
+            case 'h':
+            default:
+                printf("Usage: lz77bench <options> [files]\n");
+                printf("  -n <bytes> : Size of the generated corpora (default %d)\n", DEFAULT_SIZE);
+                printf("  -l <list> : Lookahead sizes, comma separated (default 15,255)\n");
+                printf("  -s <list> : Search-buffer sizes, comma separated (default 4095,65535)\n");
+                printf("  -m <finder> : Match finder, bt, tree or hash (default bt)\n");
+                printf("  -1 .. -9 : Compression level (default 5)\n");
+                printf("  -L <list> : Compression levels, comma separated and increasing\n");
+                printf("  -c <level> : Fail if a level from this one on compresses to more than a lower one\n");
+                printf("  -e : Huffman code the tokens\n");
+                printf("  -f <format> : Token format, triples or flagged (default triples)\n");
+                printf("  -r <value> : Runs of each configuration, the best is kept (default %d)\n", DEFAULT_REPEAT);
+                printf("  -j <file> : JSON output, - for stdout (default %s)\n", BENCH_JSON);
+                printf("The files given are benchmarked instead of the generated corpora.\n");
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    /* the corpora, loaded one at a time so that the RSS of a run is its own */
+    if (optind < argc){
+        for (i = optind; i < argc && ncorpora < MAX_CORPORA; i++, ncorpora++){
+            corpora[ncorpora].name = argv[i];
+            corpora[ncorpora].gen = NULL;
+        }
+    }else{
+        for (i = 0; i < (int)(sizeof(gens) / sizeof(gens[0])); i++, ncorpora++)
+            corpora[i] = gens[i];
+    }
+
+    if (strcmp(json, "-") == 0)
+        out = stdout;
+    else if ((out = fopen(json, "w")) == NULL){
+        perror(json);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"finder\": \"%s\", \"level\": %d, \"huffman\": %d, \"format\": \"%s\", \"runs\": %d,\n  \"results\": [",
+            finder, (lvs[0] == -1) ? 5 : lvs[0], params.huffman,
+            (params.format == LZ77_FLAGGED) ? "flagged" : "triples", repeat);
+    fprintf(stderr, "%-16s %10s %6s %9s %3s %10s %7s %10s %10s %10s\n",
+            "corpus", "size", "la", "sb", "lv", "csize", "ratio", "comp MB/s", "dec MB/s", "RSS KB");
+
+    for (i = 0; i < ncorpora; i++){
+        if (loadCorpus(&corpora[i], size) < 0){
+            perror(corpora[i].name);
+            failed = 1;
+            continue;
+        }
+        for (a = 0; a < nla; a++){
+            for (b = 0; b < nsb; b++){
+                params.la = las[a];
+                params.sb = sbs[b];
+                for (v = 0, prev = 0; v < nlv; v++){
+                    params.level = lvs[v];
+                    if (forkRun(&corpora[i], &params, repeat, &r, &rss) < 0 || !r.ok){
+                        fprintf(stderr, "%-16s %10zu %6d %9d %3d FAILED\n", corpora[i].name, corpora[i].size,
+                                las[a], sbs[b], (lvs[v] == -1) ? 5 : lvs[v]);
+                        failed = 1;
+                        continue;
+                    }
+
+                    fprintf(stderr, "%-16s %10zu %6d %9d %3d %10zu %7.3f %10.2f %10.2f %10ld%s\n",
+                            corpora[i].name, corpora[i].size, las[a], sbs[b], (lvs[v] == -1) ? 5 : lvs[v], r.csize,
+                            (double)r.csize / (corpora[i].size ? corpora[i].size : 1),
+                            corpora[i].size / 1e6 / r.ctime, corpora[i].size / 1e6 / r.dtime, rss,
+                            (check && lvs[v] >= check && prev > 0 && r.csize > prev) ? " LARGER" : "");
+                    fprintf(out, "%s\n    {\"corpus\": \"%s\", \"size\": %zu, \"la\": %d, \"sb\": %d, \"level\": %d, \"csize\": %zu, "
+                            "\"ratio\": %.4f, \"compress_mbs\": %.2f, \"decompress_mbs\": %.2f, \"peak_rss_kb\": %ld}",
+                            first ? "" : ",", corpora[i].name, corpora[i].size, las[a], sbs[b], (lvs[v] == -1) ? 5 : lvs[v],
+                            r.csize, (double)r.csize / (corpora[i].size ? corpora[i].size : 1),
+                            corpora[i].size / 1e6 / r.ctime, corpora[i].size / 1e6 / r.dtime, rss);
+                    first = 0;
+                    /* the smallest output so far, which no higher level checked may exceed */
+                    if (check && lvs[v] >= check && prev > 0 && r.csize > prev)
+                        failed = 1;
+                    if (prev == 0 || r.csize < prev)
+                        prev = r.csize;
+                }
+            }
+        }
+        free(corpora[i].data);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    return failed;
+}
@@ -18,16 +18,26 @@
  *                                CONSTANTS
  ***************************************************************************/
 #define BIT_IO_BUFFER 4096
+#define BIT_IO_WORD 4       /* bytes flushed from the accumulator at once */
 
 /***************************************************************************
  *                            TYPE DEFINITIONS
+ * Bits are kept in a 64-bit accumulator, LSB-first: the next bit to be
+ * written (read) is always bit 0 of the pending (available) ones. In write
+ * mode the accumulator is flushed into the buffer one 32-bit word at a
+ * time; in read mode it is refilled with up to 8 bytes at a time, so a
+ * whole field is moved with a couple of shifts and masks.
  ***************************************************************************/
 struct bitFILE{
-	FILE *file;     /* file to (from) write (read) */
+	FILE *file;     /* file to (from) write (read), NULL if memory-backed */
 	int mode;       /* the mode (READ or WRITE) */
-	int bytepos;    /* actual byte's position in the buffer */
-	int bitpos;     /* last bit's position in the byte */
-    int read;       /* # of bytes read from the file and stored in buffer */
+	size_t bytepos; /* actual byte's position in the buffer */
+	size_t read;    /* # of bytes read from the file and stored in buffer */
+	size_t size;    /* size of the buffer */
+	size_t done;    /* # of bytes already written (read) before the buffer */
+	int err;        /* error indicator of a memory-backed bitFILE */
+	uint64_t acc;   /* bit accumulator */
+	int nbits;      /* # of pending (available) bits in the accumulator */
 	unsigned char *buffer; /* bits buffer */
 };
 
@@ -51,9 +61,10 @@ int bitof(int n){
  ***************************************************************************/
 int bitIO_feof(struct bitFILE *bitF)
 {
-    if (feof(bitF->file) && bitF->bytepos == bitF->read)
-        return 1;
-    return 0;
+	/* a memory-backed bitFILE holds the whole stream in its buffer */
+	if ((bitF->file == NULL || feof(bitF->file)) && bitF->bytepos == bitF->read && bitF->nbits == 0)
+		return 1;
+	return 0;
 }
 
 /***************************************************************************
@@ -65,53 +76,144 @@ int bitIO_feof(struct bitFILE *bitF)
  ***************************************************************************/
 int bitIO_ferror(struct bitFILE *bitF)
 {
-    return (ferror(bitF->file));
+	if (bitF->file == NULL)
+		return bitF->err;
+	return (ferror(bitF->file));
+}
+
+/***************************************************************************
+ *						  BIT I/O TELL FUNCTION
+ * 	Name        : bitIO_tell - gives the size of the stream written so far
+ *                (a partially filled last byte counts as a whole one), or
+ *                the # of bytes consumed so far in read mode.
+ * 	Parameters  : bitF - bitFILE opened in any mode
+ * 	Returned    : # of bytes
+ ***************************************************************************/
+size_t bitIO_tell(struct bitFILE *bitF)
+{
+	if (bitF->mode == BIT_IO_W)
+		return bitF->done + bitF->bytepos + (bitF->nbits + 7) / 8;
+	return bitF->done + bitF->bytepos - bitF->nbits / 8;
 }
 
 /***************************************************************************
  *						 WRITE BUFFER FUNCTION
  * 	Name        : write_buffer - writes the used bytes of the buffer in the
  *                file opened in write mode. It is used either by the 
- *                'bitIO_write' function to flush the whole buffer, either 
- *                by the 'bitIO_close' one to write the remained bytes in 
- *                the file.
+ *                'bitIO_write_bits' function to flush the whole buffer,
+ *                either by the 'bitIO_close' one to write the remained
+ *                bytes in the file.
  * 	Parameters  : bitF - bitFILE opened in write mode
  ***************************************************************************/
-void write_buffer(struct bitFILE *bitF){
-
-	int ret;
+static void write_buffer(struct bitFILE *bitF){
 
-	/* write data */
-	ret = fwrite(bitF->buffer, 1, bitF->bytepos, bitF->file);
-	/* check for errors on writing */
-	if(ret != bitF->bytepos)
+	/* a memory-backed bitFILE can't make room: whatever doesn't fit is lost */
+	if(bitF->file == NULL)
+	{
+		bitF->err = 1;
 		return;
-	/* clear the buffer */
+	}
+
+	/* write data; on error the ferror flag of the file is set */
+	fwrite(bitF->buffer, 1, bitF->bytepos, bitF->file);
+	/* the buffer is reused anyway, so a failing writer can't overflow it */
+	bitF->done += bitF->bytepos;
 	bitF->bytepos = 0;
-	bitF->bitpos = 0;
-	memset(bitF->buffer, 0, BIT_IO_BUFFER);
 }
 
 /***************************************************************************
  *                      READ BUFFER FUNCTION
  * 	Name        : read_buffer - reads at most BIT_IO_BUFFER bytes from the
  *                bitFILE and copy them into the buffer. It is used only by
- *                the 'bitIO_read' function, once the last bit in the buffer
- *                has been read.
- * 	Parameters  : bitF - bitFILE opened in write mode
+ *                the 'refill' function, once the last byte in the buffer
+ *                has been moved in the accumulator.
+ * 	Parameters  : bitF - bitFILE opened in read mode
  ***************************************************************************/
-void read_buffer(struct bitFILE *bitF){
+static void read_buffer(struct bitFILE *bitF){
 
-	/* read data */
+	/* read data; on error the ferror flag of the file is set */
+	bitF->done += bitF->read;
 	bitF->read = fread(bitF->buffer, 1, BIT_IO_BUFFER, bitF->file);
-	/* check for errors */
-	if(bitF->read < BIT_IO_BUFFER && ferror(bitF->file))
-		return;
-	/* clear variables */
 	bitF->bytepos = 0;
-	bitF->bitpos = 0;
 }
 
+/***************************************************************************
+ *                        FLUSH WORD FUNCTION
+ * 	Name        : flush_word - moves the lowest 32 bits of the accumulator
+ *                in the buffer, writing the buffer in the file when full.
+ * 	Parameters  : bitF - bitFILE opened in write mode
+ ***************************************************************************/
+static inline void flush_word(struct bitFILE *bitF){
+
+	unsigned char *p;
+
+	if(bitF->bytepos + BIT_IO_WORD > bitF->size)
+	{
+		write_buffer(bitF);
+		if(bitF->bytepos + BIT_IO_WORD > bitF->size)
+		{
+			bitF->acc >>= 32;
+			bitF->nbits -= 32;
+			return;
+		}
+	}
+
+	/* little endian store, whatever the host is */
+	p = bitF->buffer + bitF->bytepos;
+	p[0] = (unsigned char)bitF->acc;
+	p[1] = (unsigned char)(bitF->acc >> 8);
+	p[2] = (unsigned char)(bitF->acc >> 16);
+	p[3] = (unsigned char)(bitF->acc >> 24);
+	bitF->bytepos += BIT_IO_WORD;
+
+	bitF->acc >>= 32;
+	bitF->nbits -= 32;
+}
+
+/***************************************************************************
+ *                          REFILL FUNCTION
+ * 	Name        : refill - tops the accumulator up to at least 56 bits, or
+ *                to all the remaining bits if the end of file is near.
+ * 	Parameters  : bitF - bitFILE opened in read mode
+ ***************************************************************************/
+static inline void refill(struct bitFILE *bitF){
+
+	const unsigned char *p;
+	uint64_t w;
+
+	if(bitF->nbits > 56)
+		return;
+
+	/* fast path: 8 bytes are there, load them all and keep the whole ones.
+	   The bits loaded above the kept bytes are the following bytes of the
+	   stream, so OR-ing them again on the next refill is harmless. */
+	if(bitF->read - bitF->bytepos >= 8)
+	{
+		p = bitF->buffer + bitF->bytepos;
+		w = (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 |
+			(uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+			(uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+		bitF->acc |= w << bitF->nbits;
+		bitF->bytepos += (63 - bitF->nbits) >> 3;
+		bitF->nbits |= 56;
+		return;
+	}
+
+	/* slow path: byte by byte, across buffer refills */
+	while(bitF->nbits <= 56)
+	{
+		if(bitF->bytepos == bitF->read)
+		{
+			if(bitF->file == NULL || feof(bitF->file) || ferror(bitF->file))
+				break;
+			read_buffer(bitF);
+			if(bitF->read == 0)
+				break;
+		}
+		bitF->acc |= (uint64_t)bitF->buffer[bitF->bytepos++] << bitF->nbits;
+		bitF->nbits += 8;
+	}
+}
 
 /***************************************************************************
  *						BIT I/O OPEN FUNCTION
@@ -138,24 +240,66 @@ struct bitFILE* bitIO_open(const char *path, int mode){
 	bitF = (struct bitFILE*)calloc(1, sizeof(struct bitFILE));
 	bitF->mode = mode;
 	bitF->bytepos = 0;
-	bitF->bitpos = 0;
+	bitF->read = 0;
+	bitF->size = BIT_IO_BUFFER;
+	bitF->acc = 0;
+	bitF->nbits = 0;
 	bitF->buffer = (unsigned char*)calloc(BIT_IO_BUFFER, sizeof(unsigned char));
-	memset(bitF->buffer, 0, BIT_IO_BUFFER);
 
 	/* open file */
-    /*read binary mode */
+	/*read binary mode */
 	if(bitF->mode == BIT_IO_R)
 	{
 		if((bitF->file = fopen(path, "rb")) == NULL)
-			return NULL;
+			goto error;
             
 		/* fill the buffer for the 1st time */
 		read_buffer(bitF);
 	}
-    /* write mode */
+	/* write mode */
 	else if((bitF->file = fopen(path, "w")) == NULL)
+		goto error;
+
+	return bitF;
+
+error:
+	free(bitF->buffer);
+	free(bitF);
+	return NULL;
+}
+
+/***************************************************************************
+ *					  BIT I/O OPEN MEMORY FUNCTION
+ * 	Name        : bitIO_open_mem - open a bitFILE over the memory area 'mem'
+ *                of 'size' bytes, in write or read mode. The area is used
+ *                directly as the bits buffer: no copy, no syscall. Writing
+ *                more than 'size' bytes sets the error indicator.
+ * 	Parameters  : mem - memory area holding (receiving) the stream
+ * 				  size - size of the memory area
+ * 				  mode - specify the mode: read(BIT_IO_R) or write(BIT_IO_W)
+ * 	Returned    : bitFILE just opened in the specified mode
+ ***************************************************************************/
+struct bitFILE* bitIO_open_mem(void *mem, size_t size, int mode){
+
+	struct bitFILE *bitF;
+
+	/* errors handler */
+	if(mode!=BIT_IO_W && mode!=BIT_IO_R)
+		return NULL;
+	if(mem == NULL && size > 0)
 		return NULL;
 
+	/* initialize structure */
+	bitF = (struct bitFILE*)calloc(1, sizeof(struct bitFILE));
+	if(bitF == NULL)
+		return NULL;
+	bitF->file = NULL;
+	bitF->mode = mode;
+	bitF->buffer = mem;
+	bitF->size = size;
+	/* in read mode the whole stream is already "read" */
+	bitF->read = (mode == BIT_IO_R) ? size : 0;
+
 	return bitF;
 }
 
@@ -163,7 +307,7 @@ struct bitFILE* bitIO_open(const char *path, int mode){
  *						  BIT I/O CLOSE FUNCTION
  * 	Name        : bitIO_close - closes the bitFILE given as input and frees
  *                memory portions occupied by the structures. If the file is
- *                opened in write modecand there are pending bits, these are
+ *                opened in write mode and there are pending bits, these are
  *                written in the buffer first.
  * 	Parameters  : bitF - bitFILE to close
  * 	Returned    : 0 if file closed successfully, -1 if error on inputs
@@ -171,67 +315,217 @@ struct bitFILE* bitIO_open(const char *path, int mode){
 int bitIO_close(struct bitFILE *bitF){
 
 	/* errors handler */
-	if(bitF == NULL || bitF->file == NULL)
+	if(bitF == NULL)
 		return -1;
 
 	/* write the unwritten bytes into the file */
 	if(bitF->mode == BIT_IO_W)
 	{
-		if(bitF->bitpos > 0)
-			(bitF->bytepos)++;
-		write_buffer(bitF);
+		/* pending bits, the last byte is padded with zeros */
+		while(bitF->nbits > 0)
+		{
+			if(bitF->bytepos == bitF->size)
+				write_buffer(bitF);
+			if(bitF->bytepos < bitF->size)
+				bitF->buffer[bitF->bytepos++] = (unsigned char)bitF->acc;
+			bitF->acc >>= 8;
+			bitF->nbits -= 8;
+		}
+		if(bitF->file != NULL)
+			write_buffer(bitF);
+	}
+	/* close the file, the memory of a memory-backed one is the caller's */
+	if(bitF->file != NULL)
+	{
+		fclose(bitF->file);
+		free(bitF->buffer);
 	}
-	/* close the file */
-	fclose(bitF->file);
-	/* free memory */
-	free(bitF->buffer);
 	free(bitF);
 
 	return 0;
 }
 
+/***************************************************************************
+ *						BIT I/O WRITE BITS FUNCTION
+ * 	Name        : bitIO_write_bits - writes the 'nbit' least significant bits
+ *                of 'value' in the bitFILE pointed by 'bitF', as a whole.
+ * 	Parameters  : bitF - bitFILE opened in write mode
+ * 				  value - the field to be written
+ * 				  nbit - number of bits of the field, at most 32
+ * 	Returned    : # bits written successfully, -1 if error on inputs
+ ***************************************************************************/
+int bitIO_write_bits(struct bitFILE *bitF, uint64_t value, int nbit){
+
+	/* errors handler */
+	if(bitF == NULL || bitF->mode != BIT_IO_W || nbit < 0 || nbit > 32)
+		return -1;
+
+	/* append the field above the pending bits (there are at most 31) */
+	value &= ((uint64_t)1 << nbit) - 1;
+	bitF->acc |= value << bitF->nbits;
+	bitF->nbits += nbit;
+
+	if(bitF->nbits >= 32)
+		flush_word(bitF);
+
+	if(bitIO_ferror(bitF))
+		return 0;
+
+	return nbit;
+}
+
+/***************************************************************************
+ *						BIT I/O READ BITS FUNCTION
+ * 	Name        : bitIO_read_bits - reads the next 'nbit' bits from the
+ *                bitFILE as a whole field.
+ *				  If an error occurs, or the end of the file is reached, the
+ *				  return value is a short item count (or zero), and 'value'
+ *				  holds the bits read until then.
+ * 	Parameters  : bitF - bitFILE opened in read mode
+ * 				  value - where the field is put
+ * 				  nbit - number of bits to read, at most 32
+ * 	Returned    : # bits read successfully, -1 if error on inputs
+ ***************************************************************************/
+int bitIO_read_bits(struct bitFILE *bitF, uint64_t *value, int nbit){
+
+	/* errors handler */
+	if(bitF == NULL || bitF->mode != BIT_IO_R || value == NULL || nbit < 0 || nbit > 32)
+		return -1;
+
+	if(bitF->nbits < nbit)
+	{
+		refill(bitF);
+		/* short read: hand out what is left */
+		if(bitF->nbits < nbit)
+			nbit = bitF->nbits;
+	}
+
+	*value = bitF->acc & (((uint64_t)1 << nbit) - 1);
+	bitF->acc >>= nbit;
+	bitF->nbits -= nbit;
+
+	return nbit;
+}
+
+/***************************************************************************
+ *						BIT I/O PEEK BITS FUNCTION
+ * 	Name        : bitIO_peek_bits - gives the next bits of the bitFILE
+ *				  without consuming them, for variable length fields.
+ * 	Parameters  : bitF - bitFILE opened in read mode
+ * 				  value - where the bits are put, LSB first
+ * 	Returned    : # of valid bits in 'value': at least 56, unless the end of
+ *				  the file is near; -1 if error on inputs
+ ***************************************************************************/
+int bitIO_peek_bits(struct bitFILE *bitF, uint64_t *value){
+
+	/* errors handler */
+	if(bitF == NULL || bitF->mode != BIT_IO_R || value == NULL)
+		return -1;
+
+	refill(bitF);
+	*value = bitF->acc;
+
+	return bitF->nbits;
+}
+
+/***************************************************************************
+ *						BIT I/O SKIP BITS FUNCTION
+ * 	Name        : bitIO_skip_bits - consumes bits given by bitIO_peek_bits
+ * 	Parameters  : bitF - bitFILE opened in read mode
+ * 				  nbit - number of bits, at most the # given by the peek
+ * 	Returned    : # bits skipped, -1 if error on inputs
+ ***************************************************************************/
+int bitIO_skip_bits(struct bitFILE *bitF, int nbit){
+
+	/* errors handler */
+	if(bitF == NULL || bitF->mode != BIT_IO_R || nbit < 0 || nbit > bitF->nbits)
+		return -1;
+
+	bitF->acc = (nbit < 64) ? bitF->acc >> nbit : 0;
+	bitF->nbits -= nbit;
+
+	return nbit;
+}
+
+/***************************************************************************
+ *						BIT I/O READ BYTES FUNCTION
+ * 	Name        : bitIO_read_bytes - reads 'n' whole bytes, from a byte
+ *                boundary of the stream: the ones of the accumulator, then
+ *                straight from the buffer with memcpy.
+ * 	Parameters  : bitF - bitFILE opened in read mode, at a byte boundary
+ * 				  dst - where the bytes go
+ * 				  n - number of bytes
+ * 	Returned    : # bytes read, short at the end of the file; -1 if error on
+ *                inputs
+ ***************************************************************************/
+int bitIO_read_bytes(struct bitFILE *bitF, void *dst, int n){
+
+	unsigned char *p = dst;
+	int got = 0;
+	size_t m;
+
+	/* errors handler */
+	if(bitF == NULL || bitF->mode != BIT_IO_R || dst == NULL || n < 0 || (bitF->nbits & 7) != 0)
+		return -1;
+
+	while(got < n && bitF->nbits > 0)
+	{
+		p[got++] = (unsigned char)bitF->acc;
+		bitF->acc >>= 8;
+		bitF->nbits -= 8;
+	}
+	/* the bits loaded past the accumulator's (see refill) are skipped */
+	if(bitF->nbits == 0)
+		bitF->acc = 0;
+
+	while(got < n)
+	{
+		if(bitF->bytepos == bitF->read)
+		{
+			if(bitF->file == NULL || feof(bitF->file) || ferror(bitF->file))
+				break;
+			read_buffer(bitF);
+			if(bitF->read == 0)
+				break;
+		}
+		m = ((size_t)(n - got) < bitF->read - bitF->bytepos) ? (size_t)(n - got) : bitF->read - bitF->bytepos;
+		memcpy(&(p[got]), &(bitF->buffer[bitF->bytepos]), m);
+		bitF->bytepos += m;
+		got += m;
+	}
+
+	return got;
+}
+
 /***************************************************************************
  *							BIT I/O WRITE FUNCTION
  * 	Name        : bitIO_write - writes the first 'nbit' pointed by 'info' in
  *                the bitFILE pointed by 'bitF'.
  * 	Parameters  : bitF - bitFILE opened in write mode
  * 				  info - buffer containing information to be written
- * 				  nbytes - number of bytes to be written from the buffer
  * 				  nbit - number of bits required to represent the information
  * 	Returned    : # bits written successfully, -1 if error on inputs
  ***************************************************************************/
 int bitIO_write(struct bitFILE *bitF, void *info, int nbit){
 
-	int i;
-	int byte_pos = 0, bit_pos = 0; /* byte's position and bit's position */
-	unsigned char mask; /* mask of bits */
+	int i, j, n;
+	uint64_t value;
+	unsigned char *p = info;
 
 	/* errors handler */
-	if(bitF == NULL || bitF->file == NULL || bitF->mode != BIT_IO_W|| info == NULL || nbit < 0)
+	if(bitF == NULL || bitF->mode != BIT_IO_W|| info == NULL || nbit < 0)
 		return -1;
 
-	for(i=0; i<nbit; i++)
+	/* move the information 32 bits (4 bytes) at a time */
+	for(i = 0; i < nbit; i += n)
 	{
-		/* get bit to write */
-		mask = 1 << bit_pos;
-        
-        /* if it is a 1 set it, otherwise do nothing */
-		if((*(unsigned char *)(info + byte_pos) & mask) != 0)
-			bitF->buffer[bitF->bytepos] |= (1 << bitF->bitpos);
-        
-        /* update info to write variables */
-		byte_pos = (bit_pos < 7)? byte_pos : (byte_pos + 1);
-		bit_pos = (bit_pos < 7)? (bit_pos + 1) : 0;
-        
-        /* update bitF structure */
-		bitF->bytepos = (bitF->bitpos < 7)? bitF->bytepos : (bitF->bytepos + 1);
-		bitF->bitpos = (bitF->bitpos <7)? (bitF->bitpos + 1) : 0;
-        
-		/* check if a write_buffer must be done */
-		if(bitF->bytepos == BIT_IO_BUFFER)
-			write_buffer(bitF);
-		/* check for writing errors */		
-		if(bitIO_ferror(bitF) != 0)
+		n = (nbit - i < 32) ? (nbit - i) : 32;
+
+		value = 0;
+		for(j = 0; j < (n + 7) / 8; j++)
+			value |= (uint64_t)p[i / 8 + j] << (8 * j);
+
+		if(bitIO_write_bits(bitF, value, n) != n)
 			break;
 	}
 
@@ -255,43 +549,35 @@ int bitIO_write(struct bitFILE *bitF, void *info, int nbit){
  ***************************************************************************/
 int bitIO_read(struct bitFILE *bitF, void *info, int info_s, int nbit){
 
-	int i;
-	int byte_pos = 0, bit_pos = 0; /* byte's position and bit's position */
-	unsigned char mask; /* mask of bits */
+	int i, j, n, got;
+	uint64_t value;
+	unsigned char *p = info;
 
 	/* errors handler */
-	if(bitF == NULL || bitF->file == NULL || bitF->mode != BIT_IO_R || info == NULL || info_s <= 0 || nbit < 0)
+	if(bitF == NULL || bitF->mode != BIT_IO_R || info == NULL || info_s <= 0 || nbit < 0)
 		return -1;
 
 	/* clear the 'info' buffer */
 	memset(info, 0, info_s);
-    
-	/* begin the reading */
-	for(i=0; i<nbit && (bitIO_feof(bitF) != 1); i++)
+
+	/* never write past the end of 'info' */
+	if(nbit > info_s * 8)
+		nbit = info_s * 8;
+
+	/* move the information 32 bits (4 bytes) at a time */
+	for(i = 0; i < nbit; i += got)
 	{
-		/* get bit to read */
-		mask = 1 << bitF->bitpos;
-        
-        /* if it is a 1 set it, otherwise do nothing */
-		if((bitF->buffer[bitF->bytepos] & mask) != 0)
-			*(unsigned char *)(info + byte_pos) |= (1 << bit_pos);
-        
-		/* update buffers */
-        /* update info to write variables */
-		byte_pos = (bit_pos < 7)? byte_pos : (byte_pos + 1);
-		bit_pos = (bit_pos < 7)? (bit_pos + 1) : 0;
-        
-        /* update bitF structure */
-		bitF->bytepos = (bitF->bitpos < 7)? bitF->bytepos : (bitF->bytepos + 1);
-		bitF->bitpos = (bitF->bitpos <7)? (bitF->bitpos + 1) : 0;
-
-		/* check if it read all bits from the file and, if it is the case, 
-           it reads new bytes from the file */
-		if(bitF->bytepos == BIT_IO_BUFFER)
-			read_buffer(bitF);
-		/* check for reading errors */
-		if(bitIO_ferror(bitF) != 0)
+		n = (nbit - i < 32) ? (nbit - i) : 32;
+
+		got = bitIO_read_bits(bitF, &value, n);
+		for(j = 0; j < (got + 7) / 8; j++)
+			p[i / 8 + j] = (unsigned char)(value >> (8 * j));
+
+		if(got < n)
+		{
+			i += got;
 			break;
+		}
 	}
 
 	return i;
@@ -6,6 +6,12 @@
  *
  ***************************************************************************/
 
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
 /***************************************************************************
  *                                CONSTANTS
  ***************************************************************************/
@@ -26,7 +32,14 @@ int bitof(int n);
 int bitIO_feof(struct bitFILE *bitF);
 int bitIO_ferror(struct bitFILE *bitF);
 struct bitFILE* bitIO_open(const char *path, int mode);
+struct bitFILE* bitIO_open_mem(void *mem, size_t size, int mode);
+size_t bitIO_tell(struct bitFILE *bitF);
 int bitIO_close(struct bitFILE *bitF);
 int bitIO_write(struct bitFILE *bitF, void *info, int nbit);
 int bitIO_read(struct bitFILE *bitF, void *info, int info_s, int nbit);
+int bitIO_write_bits(struct bitFILE *bitF, uint64_t value, int nbit);
+int bitIO_read_bits(struct bitFILE *bitF, uint64_t *value, int nbit);
+int bitIO_peek_bits(struct bitFILE *bitF, uint64_t *value);
+int bitIO_skip_bits(struct bitFILE *bitF, int nbit);
+int bitIO_read_bytes(struct bitFILE *bitF, void *dst, int n);
 #endif
@@ -0,0 +1,278 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : bt.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdlib.h>
+#include "alloc.h"
+#include "tree.h"
+#include "bt.h"
+#include "lcp.h"
+#include "stats.h"
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define HASH_SIZE (1 << 16)
+#define HASH_MIN 2          /* # of bytes hashed, shorter matches are missed */
+#define NIL 0                /* no position: always out of the search buffer */
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ * A binary search tree of the search buffer's positions for each value of
+ * their first 2 bytes (as in the LZMA "bt2" match finder). Unlike the tree
+ * of tree.c it is never balanced nor cleaned: the new position becomes the
+ * root of its tree, and the old tree is split in its left and right subtree
+ * while walking it down to look for the longest match. Nodes are never
+ * deleted, a walk just stops at the first position out of the search
+ * buffer.
+ * The work per position is bounded by 'depth' visited nodes whatever the
+ * data is, since a cut walk still leaves a consistent tree behind it (the
+ * subtrees not visited are simply dropped).
+ * Positions are absolute: a position is at '(pos - base) & wmask' in the
+ * ring buffer, whose first byte is at 'base'. The encoder's positions
+ * start above the search buffer size, so that NIL is always out of it.
+ ***************************************************************************/
+struct binTree{
+    unsigned int *head; /* root of the tree of each 2 bytes value */
+    unsigned int *son;  /* left and right child of each position */
+    unsigned int last[256]; /* last position of each byte value */
+    unsigned int mask;  /* son has 2 * (mask + 1) > search buffer size entries */
+    unsigned int size;  /* search buffer size */
+    int depth;          /* max # of nodes visited per position */
+    const struct lz77_alloc *alloc; /* where the memory comes from */
+};
+
+/***************************************************************************
+ *                        CREATE BIN TREE FUNCTION
+ * Name         : createBinTree - memory allocation for the binary tree
+ * Parameters   : size - search buffer size
+ *                depth - max # of nodes visited per position
+ *                a - allocator, NULL for malloc
+ * Returned     : pointer to the binary tree, NULL if there is no memory
+ ***************************************************************************/
+struct binTree *createBinTree(int size, int depth, const struct lz77_alloc *a)
+{
+    int i, n = 1;
+    struct binTree *bt = memCalloc(a, sizeof(struct binTree));
+    
+    if (bt == NULL)
+        return NULL;
+    /* power of two, so that a position is mapped in son by masking */
+    while (n <= size)
+        n <<= 1;
+    
+    bt->alloc = a;
+    bt->head = memAlloc(a, HASH_SIZE * sizeof(unsigned int));
+    bt->son = memAlloc(a, 2 * n * sizeof(unsigned int));
+    if (bt->head == NULL || bt->son == NULL){
+        destroyBinTree(bt);
+        return NULL;
+    }
+    bt->mask = n - 1;
+    bt->size = size;
+    bt->depth = depth;
+    
+    for (i = 0; i < HASH_SIZE; i++)
+        bt->head[i] = NIL;
+    for (i = 0; i < 256; i++)
+        bt->last[i] = NIL;
+    
+    return bt;
+}
+
+/***************************************************************************
+ *                       DESTROY BIN TREE FUNCTION
+ * Name         : destroyBinTree - memory deallocation of the binary tree
+ * Parameters   : bt - pointer to the binary tree
+ ***************************************************************************/
+void destroyBinTree(struct binTree *bt)
+{
+    memFree(bt->alloc, bt->head);
+    memFree(bt->alloc, bt->son);
+    memFree(bt->alloc, bt);
+}
+
+/***************************************************************************
+ *                             WALK FUNCTION
+ * Name         : walk - insert the position as the new root of its tree,
+ *                splitting the old tree while walking it down, and keep the
+ *                longest match met on the way
+ * Parameters   : bt - pointer to the binary tree
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                base - position of window[0]
+ *                pos - absolute position
+ *                size - actual lookahead size
+ *                all - where the longer and longer matches met go, NULL
+ *                      if only the longest one is wanted
+ *                stats - the walk is a find (1) or an insert (0), for the
+ *                        statistics only
+ * Returned     : best match's offset and length
+ ***************************************************************************/
+static struct ret walk(struct binTree *bt, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size,
+                       struct matches *all, int stats)
+{
+    /* variables */
+    unsigned char *cur = &(window[(pos - base) & wmask]);
+    unsigned char *pb;
+    unsigned int cand, delta;
+    int h, depth = bt->depth;
+    int len, len0 = 0, len1 = 0;
+    int limit = size - 1;       /* the next char must stay in the lookahead */
+    unsigned int *ptr0, *ptr1, *pair;
+    struct ret off_len;
+    
+    /* initialize as non-match values */
+    off_len.off = 0;
+    off_len.len = 0;
+    if (all != NULL)
+        all->n = 0;
+    
+    /* too close to the end of the data to be inserted */
+    if (size < HASH_MIN)
+        return off_len;
+    
+    /* a 1 byte match is still worth a token: remember the last one */
+    cand = bt->last[cur[0]];
+    bt->last[cur[0]] = pos;
+    if (pos - cand <= bt->size){
+        off_len.off = pos - cand;
+        off_len.len = 1;
+        addMatch(all, off_len.off, 1);
+    }
+    
+    h = (cur[0] << 8) | cur[1];
+    cand = bt->head[h];
+    bt->head[h] = pos;
+    
+    /* where the greater (ptr0) and smaller (ptr1) subtree will hang */
+    ptr0 = &(bt->son[2 * (pos & bt->mask) + 1]);
+    ptr1 = &(bt->son[2 * (pos & bt->mask)]);
+    
+    while (1){
+        delta = pos - cand;
+        
+        /* end of the tree, of the search buffer or of the work allowed */
+        if (delta > bt->size || depth-- == 0){
+            *ptr0 = *ptr1 = NIL;
+            break;
+        }
+        
+        pair = &(bt->son[2 * (cand & bt->mask)]);
+        pb = &(window[(cand - base) & wmask]);
+        
+        /* both the bounds of the subtree share this prefix with the lookahead */
+        len = (len0 < len1) ? len0 : len1;
+        
+        if (pb[len] == cur[len]){
+            len++;
+            len += matchLength(&(pb[len]), &(cur[len]), limit - len);
+            
+            STATS_ADD(cmpBytes, len);
+            
+            if (len > off_len.len){
+                off_len.off = delta;
+                off_len.len = len;
+                addMatch(all, delta, len);
+            }
+            
+            /* same sequence: it takes the place of the candidate */
+            if (len == limit){
+                *ptr1 = pair[0];
+                *ptr0 = pair[1];
+                break;
+            }
+        }
+        
+        if (pb[len] < cur[len]){
+            /* the candidate and its smaller subtree go to the left */
+            *ptr1 = cand;
+            ptr1 = pair + 1;
+            cand = *ptr1;
+            len1 = len;
+        }else{
+            /* the candidate and its greater subtree go to the right */
+            *ptr0 = cand;
+            ptr0 = pair;
+            cand = *ptr0;
+            len0 = len;
+        }
+    }
+    
+    /* a walk cut by the depth has decremented it once more */
+    if (stats)
+        STATS_DEPTH(find, bt->depth - depth - (depth < 0));
+    else
+        STATS_DEPTH(insert, bt->depth - depth - (depth < 0));
+    
+    return off_len;
+}
+
+/***************************************************************************
+ *                         BIN TREE FIND FUNCTION
+ * Name         : binTreeFind - find the longest match of the lookahead and
+ *                insert its position in the tree
+ * Parameters   : bt - pointer to the binary tree
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                base - position of window[0]
+ *                pos - absolute position of the lookahead
+ *                size - actual lookahead size
+ *                all - where the longer and longer matches met go, NULL
+ *                      if only the longest one is wanted
+ * Returned     : best match's offset and length
+ ***************************************************************************/
+struct ret binTreeFind(struct binTree *bt, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size,
+                       struct matches *all)
+{
+    return walk(bt, window, wmask, base, pos, size, all, 1);
+}
+
+/***************************************************************************
+ *                        BIN TREE INSERT FUNCTION
+ * Name         : binTreeInsert - insert a position in the tree, skipping
+ *                it (e.g. inside a match)
+ * Parameters   : bt - pointer to the binary tree
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                base - position of window[0]
+ *                pos - absolute position
+ *                size - actual lookahead size
+ ***************************************************************************/
+void binTreeInsert(struct binTree *bt, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size)
+{
+    walk(bt, window, wmask, base, pos, size, NULL, 0);
+}
+
+/* subtract 'n' from a position, the ones older than 'n' become NIL */
+static inline unsigned int sub(unsigned int pos, unsigned int n)
+{
+    return (pos > n) ? (pos - n) : NIL;
+}
+
+/***************************************************************************
+ *                      BIN TREE NORMALIZE FUNCTION
+ * Name         : binTreeNormalize - bring the positions back before they
+ *                overflow (once every couple of GB); positions older than
+ *                'n' are out of the search buffer anyway and become NIL
+ * Parameters   : bt - pointer to the binary tree
+ *                n - value to subtract, a multiple of mask + 1
+ ***************************************************************************/
+void binTreeNormalize(struct binTree *bt, unsigned int n)
+{
+    unsigned int i;
+    
+    for (i = 0; i < HASH_SIZE; i++)
+        bt->head[i] = sub(bt->head[i], n);
+    for (i = 0; i < 2 * (bt->mask + 1); i++)
+        bt->son[i] = sub(bt->son[i], n);
+    for (i = 0; i < 256; i++)
+        bt->last[i] = sub(bt->last[i], n);
+}
@@ -0,0 +1,25 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : bt.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef bt_h
+#define bt_h
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ ***************************************************************************/
+struct binTree;
+struct matches;
+
+/***************************************************************************
+ *                         FUNCTIONS DECLARATION
+ ***************************************************************************/
+struct binTree *createBinTree(int size, int depth, const struct lz77_alloc *a);
+void destroyBinTree(struct binTree *bt);
+struct ret binTreeFind(struct binTree *bt, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size,
+                       struct matches *all);
+void binTreeInsert(struct binTree *bt, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size);
+void binTreeNormalize(struct binTree *bt, unsigned int n);
+#endif
@@ -0,0 +1,220 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : checksum.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ *   CRC-32C, the CRC of the Castagnoli polynomial, which x86 computes 8
+ *   bytes at a time with the crc32 instruction of SSE4.2. The instruction
+ *   takes 3 cycles but a new one starts each cycle, so the data is cut in
+ *   three lanes whose CRCs are computed side by side, then joined with a
+ *   carry-less multiplication (PCLMUL). Elsewhere the CRC is computed by
+ *   tables, 8 bytes at a time. The kernel is chosen at the first call from
+ *   what the CPU supports, as the ones of lcp.c.
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <string.h>
+#include <pthread.h>
+#include "checksum.h"
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define CRC_X86
+#endif
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define POLY 0x82F63B78             /* the Castagnoli polynomial, bits reversed */
+
+#define LANE_LONG 1024              /* bytes of a lane of the large inputs */
+#define LANE_SHORT 128              /* and of what is left of them */
+
+/* x^(8n-33) modulo the polynomial, bits reversed: the carry-less product
+   of a CRC by it, reduced by the crc32 instruction, is the CRC moved past
+   n zero bytes, that is in front of the next n bytes */
+#define SHIFT_LONG 0x170076FA       /* n = LANE_LONG */
+#define SHIFT_LONG2 0xA51B6135      /* n = 2 * LANE_LONG */
+#define SHIFT_SHORT 0x0D3B6092      /* n = LANE_SHORT */
+#define SHIFT_SHORT2 0xB9E02B86     /* n = 2 * LANE_SHORT */
+
+/***************************************************************************
+ *                            GLOBAL VARIABLES
+ ***************************************************************************/
+static uint32_t crcTable[8][256];   /* CRC of a byte followed by 0 to 7 zero bytes */
+static pthread_once_t tableOnce = PTHREAD_ONCE_INIT;
+
+static uint32_t crcResolve(uint32_t crc, const unsigned char *p, size_t n);
+static uint32_t (*crcKernel)(uint32_t crc, const unsigned char *p, size_t n) = crcResolve;
+
+/***************************************************************************
+ *                           CRC TABLES FUNCTION
+ * Name         : crcTables - fill the tables of crcSoft, once
+ ***************************************************************************/
+static void crcTables(void)
+{
+    uint32_t c;
+    int i, k;
+    
+    for (i = 0; i < 256; i++){
+        c = i;
+        for (k = 0; k < 8; k++)
+            c = (c >> 1) ^ ((c & 1) ? POLY : 0);
+        crcTable[0][i] = c;
+    }
+    for (i = 0; i < 256; i++)
+        for (k = 1; k < 8; k++)
+            crcTable[k][i] = (crcTable[k - 1][i] >> 8) ^ crcTable[0][crcTable[k - 1][i] & 0xFF];
+}
+
+/***************************************************************************
+ *                            CRC SOFT FUNCTION
+ * Name         : crcSoft - go on with a CRC, 8 bytes a round: the CRC of
+ *                each byte, followed by the ones after it in the round, is
+ *                looked up in its own table
+ * Parameters   : crc - CRC of the bytes before
+ *                p - the bytes
+ *                n - their #
+ * Returned     : the CRC with them
+ ***************************************************************************/
+static uint32_t crcSoft(uint32_t crc, const unsigned char *p, size_t n)
+{
+    pthread_once(&tableOnce, crcTables);
+    
+    for (; n >= 8; p += 8, n -= 8){
+        crc ^= p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        crc = crcTable[7][crc & 0xFF] ^ crcTable[6][(crc >> 8) & 0xFF] ^ crcTable[5][(crc >> 16) & 0xFF]
+              ^ crcTable[4][crc >> 24] ^ crcTable[3][p[4]] ^ crcTable[2][p[5]] ^ crcTable[1][p[6]] ^ crcTable[0][p[7]];
+    }
+    for (; n > 0; p++, n--)
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *p) & 0xFF];
+    
+    return crc;
+}
+
+#ifdef CRC_X86
+/***************************************************************************
+ *                            CRC LANES FUNCTION
+ * Name         : crcLanes - go on with a CRC three lanes of 'lane' bytes a
+ *                round: the CRCs of the second and third lanes start from
+ *                0, and the ones of the first two are moved in front of the
+ *                lanes after them (see SHIFT_LONG), which is linear
+ * Parameters   : crc - CRC of the bytes before
+ *                p, n - the bytes and their #, moved past the rounds
+ *                lane - bytes of a lane
+ *                shift, shift2 - the constants of 'lane' and 2 * 'lane'
+ * Returned     : the CRC with the bytes of the rounds
+ ***************************************************************************/
+__attribute__((target("sse4.2,pclmul")))
+static inline uint64_t crcLanes(uint64_t crc, const unsigned char **p, size_t *n, size_t lane, uint64_t shift, uint64_t shift2)
+{
+    const unsigned char *q = *p;
+    uint64_t c1, c2, w0, w1, w2;
+    size_t i;
+    
+    for (; *n >= 3 * lane; *n -= 3 * lane, q += 3 * lane){
+        c1 = c2 = 0;
+        for (i = 0; i < lane; i += 8){
+            memcpy(&w0, q + i, 8);
+            memcpy(&w1, q + lane + i, 8);
+            memcpy(&w2, q + 2 * lane + i, 8);
+            crc = _mm_crc32_u64(crc, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+        }
+        w0 = _mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_cvtsi64_si128(crc), _mm_cvtsi64_si128(shift2), 0));
+        w1 = _mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_cvtsi64_si128(c1), _mm_cvtsi64_si128(shift), 0));
+        crc = _mm_crc32_u64(0, w0 ^ w1) ^ c2;
+    }
+    *p = q;
+    
+    return crc;
+}
+
+/***************************************************************************
+ *                            CRC HARD FUNCTION
+ * Name         : crcHard - go on with a CRC with the crc32 instruction, on
+ *                three lanes while there are enough bytes for them
+ * Parameters   : crc - CRC of the bytes before
+ *                p - the bytes
+ *                n - their #
+ * Returned     : the CRC with them
+ ***************************************************************************/
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crcHard(uint32_t crc, const unsigned char *p, size_t n)
+{
+    uint64_t c = crc, w;
+    
+    c = crcLanes(c, &p, &n, LANE_LONG, SHIFT_LONG, SHIFT_LONG2);
+    c = crcLanes(c, &p, &n, LANE_SHORT, SHIFT_SHORT, SHIFT_SHORT2);
+    for (; n >= 8; p += 8, n -= 8){
+        memcpy(&w, p, 8);
+        c = _mm_crc32_u64(c, w);
+    }
+    for (; n > 0; p++, n--)
+        c = _mm_crc32_u8(c, *p);
+    
+    return c;
+}
+#endif
+
+/***************************************************************************
+ *                           CRC RESOLVE FUNCTION
+ * Name         : crcResolve - choose the kernel at the first call. Threads
+ *                racing here all store the same kernel.
+ * Parameters   : crc - CRC of the bytes before
+ *                p - the bytes
+ *                n - their #
+ * Returned     : the CRC with them
+ ***************************************************************************/
+static uint32_t crcResolve(uint32_t crc, const unsigned char *p, size_t n)
+{
+#ifdef CRC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul"))
+        crcKernel = crcHard;
+    else
+        crcKernel = crcSoft;
+#else
+    crcKernel = crcSoft;
+#endif
+    
+    return crcKernel(crc, p, n);
+}
+
+/***************************************************************************
+ *                          CHECKSUM INIT FUNCTION
+ * Name         : checksumInit - start the checksum of some data
+ * Parameters   : c - checksum
+ ***************************************************************************/
+void checksumInit(struct checksum *c)
+{
+    c->crc = 0xFFFFFFFF;
+}
+
+/***************************************************************************
+ *                         CHECKSUM UPDATE FUNCTION
+ * Name         : checksumUpdate - add the next bytes of the data
+ * Parameters   : c - checksum
+ *                data - the bytes
+ *                len - their #
+ ***************************************************************************/
+void checksumUpdate(struct checksum *c, const void *data, size_t len)
+{
+    if (len > 0)
+        c->crc = crcKernel(c->crc, data, len);
+}
+
+/***************************************************************************
+ *                         CHECKSUM DIGEST FUNCTION
+ * Name         : checksumDigest - the checksum of the data given so far;
+ *                more may still be added
+ * Parameters   : c - checksum
+ * Returned     : the CRC-32C of the data
+ ***************************************************************************/
+uint32_t checksumDigest(const struct checksum *c)
+{
+    return ~c->crc;
+}
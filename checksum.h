@@ -0,0 +1,30 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : checksum.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef checksum_h
+#define checksum_h
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ * The state of a CRC-32C checksum of data given in pieces.
+ ***************************************************************************/
+struct checksum{
+    uint32_t crc;               /* CRC of the data so far, not inverted yet */
+};
+
+/***************************************************************************
+ *                         FUNCTIONS DECLARATION
+ ***************************************************************************/
+void checksumInit(struct checksum *c);
+void checksumUpdate(struct checksum *c, const void *data, size_t len);
+uint32_t checksumDigest(const struct checksum *c);
+#endif
@@ -0,0 +1,819 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : frame.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ *   The framed format splits the input in blocks compressed independently,
+ *   so that they can be compressed in parallel:
+ *
+ *     +-------+---------+-------+------+------------+---------+-----+-----+
+ *     | magic | version | flags | rsvd | block size | block 0 | ... | end |
+ *     +-------+---------+-------+------+------------+---------+-----+-----+
+ *        4         1        1      2         4
+ *
+ *   Each block is its uncompressed and compressed size (4 bytes each) and
+ *   the single-stream format (see lz77.c) of its data; the end is a block
+ *   with both sizes 0. Integers are little endian. The 4th byte of the
+ *   magic is not 0, while it is the high byte of the lookahead size in a
+ *   single stream: the two formats can't be mistaken.
+ *
+ *   If FRAME_INDEX is set in the flags, the end is followed by the index of
+ *   the blocks, so that they can be found without reading the whole file:
+ *
+ *     +---------+-----+-----------+-------------+-------------+
+ *     | entry 0 | ... | entry n-1 | # of blocks | index magic |
+ *     +---------+-----+-----------+-------------+-------------+
+ *                                       4              4
+ *
+ *   Each entry is the offset of the block header in the file and of the
+ *   block in the uncompressed data (8 bytes each), then the compressed and
+ *   uncompressed size of the block (4 bytes each).
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bitio.h"
+#include "lz77.h"
+#include "stats.h"
+#include "frame.h"
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define FRAME_VERSION 1
+#define FRAME_INDEX 0x01        /* flag: the frame ends with the index */
+#define FRAME_HEADER 12         /* size of the frame header */
+#define BLOCK_HEADER 8          /* size of a block header */
+#define INDEX_ENTRY 24          /* size of an entry of the index */
+#define INDEX_TRAILER 8         /* size of the end of the index */
+#define BLOCK_SIZE (1 << 20)    /* uncompressed size of a block */
+#define MAX_BLOCK_SIZE (1 << 30)
+#define JOBS_PER_THREAD 2       /* blocks in memory per worker */
+
+#define JOB_FREE 0
+#define JOB_READY 1
+#define JOB_DONE 2
+
+static const unsigned char magic[4] = {'L', 'Z', '7', 'F'};
+static const unsigned char indexMagic[4] = {'L', 'Z', '7', 'X'};
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ * Blocks are read in order in a ring of jobs, compressed by the workers in
+ * any order and written in order: at most 'njobs' blocks are in memory.
+ ***************************************************************************/
+struct job{
+    unsigned char *in;          /* uncompressed block */
+    unsigned char *out;         /* compressed block */
+    size_t inLen, outLen;       /* their sizes */
+    size_t outCap;              /* capacity of 'out' */
+    int state;                  /* JOB_FREE, JOB_READY or JOB_DONE */
+};
+
+struct pool{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;       /* a block can be compressed */
+    pthread_cond_t done;        /* a block has been compressed */
+    struct job *jobs;           /* ring of jobs */
+    int njobs;                  /* its size */
+    long read, taken, written;  /* # of blocks read, taken by the workers, written */
+    int stop;                   /* no more blocks will come */
+    const struct lz77_params *params;
+};
+
+/* a block in the index */
+struct blockIndex{
+    uint64_t coff;              /* offset of the block header in the file */
+    uint64_t uoff;              /* offset of the block in the data */
+    unsigned int csize, usize;  /* compressed and uncompressed size */
+};
+
+/* blocks are handed to the decoding workers in any order */
+struct decodePool{
+    pthread_mutex_t lock;
+    const struct blockIndex *index;
+    long count, next;           /* # of blocks, next one to decode */
+    size_t block;               /* max uncompressed size of a block */
+    int fdIn, fdOut;
+    int err;                    /* a worker failed */
+};
+
+/***************************************************************************
+ *                        LITTLE ENDIAN FUNCTIONS
+ ***************************************************************************/
+static void put32(unsigned char *p, unsigned int v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static unsigned int get32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void put64(unsigned char *p, uint64_t v)
+{
+    put32(p, v);
+    put32(p + 4, v >> 32);
+}
+
+static uint64_t get64(const unsigned char *p)
+{
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+/***************************************************************************
+ *                          FRAME PROBE FUNCTION
+ * Name         : frameProbe - tell the framed format from the single stream
+ *                one by the first bytes of the file, so that it works on
+ *                pipes too
+ * Parameters   : head - first bytes of the compressed file
+ *                n - their #, FRAME_MAGIC_SIZE unless the file is shorter
+ * Returned     : 1 if framed, 0 if not
+ ***************************************************************************/
+int frameProbe(const unsigned char *head, size_t n)
+{
+    return (n == sizeof(magic) && memcmp(head, magic, sizeof(magic)) == 0);
+}
+
+/***************************************************************************
+ *                            WORKER FUNCTION
+ * Name         : worker - compress the blocks read by the main thread
+ * Parameters   : arg - the pool
+ ***************************************************************************/
+static void *worker(void *arg)
+{
+    struct pool *pool = arg;
+    struct job *job;
+    /* one encoder per worker, reset from block to block */
+    struct lz77_encoder *e = lz77_encoder_create(pool->params);
+    
+    pthread_mutex_lock(&pool->lock);
+    while (1){
+        while (pool->taken == pool->read && !pool->stop)
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        if (pool->taken == pool->read)
+            break;
+        
+        job = &(pool->jobs[pool->taken++ % pool->njobs]);
+        pthread_mutex_unlock(&pool->lock);
+        
+        job->outLen = (e != NULL) ? lz77_compress_ctx(e, job->in, job->inLen, job->out, job->outCap) : LZ77_ERROR;
+        
+        pthread_mutex_lock(&pool->lock);
+        job->state = JOB_DONE;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    lz77_encoder_destroy(e);
+    STATS_MERGE();
+    
+    return NULL;
+}
+
+/***************************************************************************
+ *                          WRITE INDEX FUNCTION
+ * Name         : writeIndex - write the index at the end of the frame
+ * Parameters   : out - compressed file
+ *                index - the blocks
+ *                count - # of blocks
+ * Returned     : 0 on success, -1 on errors
+ ***************************************************************************/
+static int writeIndex(FILE *out, const struct blockIndex *index, long count)
+{
+    unsigned char buf[INDEX_ENTRY];
+    long i;
+    
+    for (i = 0; i < count; i++){
+        put64(buf, index[i].coff);
+        put64(&(buf[8]), index[i].uoff);
+        put32(&(buf[16]), index[i].csize);
+        put32(&(buf[20]), index[i].usize);
+        if (fwrite(buf, 1, INDEX_ENTRY, out) != INDEX_ENTRY)
+            return -1;
+    }
+    
+    put32(buf, count);
+    memcpy(&(buf[4]), indexMagic, sizeof(indexMagic));
+    if (fwrite(buf, 1, INDEX_TRAILER, out) != INDEX_TRAILER)
+        return -1;
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                           READ INDEX FUNCTION
+ * Name         : readIndex - read and check the index at the end of a frame
+ * Parameters   : in - compressed file, it must be seekable
+ *                block - max uncompressed size of a block
+ *                count - where the # of blocks goes
+ * Returned     : the blocks (to be freed), NULL if there's no valid index
+ ***************************************************************************/
+static struct blockIndex *readIndex(FILE *in, size_t block, long *count)
+{
+    unsigned char buf[INDEX_ENTRY];
+    struct blockIndex *index;
+    off_t size, start;
+    uint64_t coff = FRAME_HEADER, uoff = 0;
+    long i, n;
+    
+    if (fseeko(in, 0, SEEK_END) != 0 || (size = ftello(in)) < FRAME_HEADER + BLOCK_HEADER + INDEX_TRAILER)
+        return NULL;
+    if (fseeko(in, size - INDEX_TRAILER, SEEK_SET) != 0 || fread(buf, 1, INDEX_TRAILER, in) != INDEX_TRAILER)
+        return NULL;
+    if (memcmp(&(buf[4]), indexMagic, sizeof(indexMagic)) != 0)
+        return NULL;
+    
+    /* the index follows the end of the frame */
+    n = get32(buf);
+    start = size - INDEX_TRAILER - (off_t)n * INDEX_ENTRY;
+    if (start < FRAME_HEADER + BLOCK_HEADER || fseeko(in, start, SEEK_SET) != 0)
+        return NULL;
+    if ((index = malloc((n ? n : 1) * sizeof(struct blockIndex))) == NULL)
+        return NULL;
+    
+    /* the blocks must be contiguous, both in the file and in the data */
+    for (i = 0; i < n; i++){
+        if (fread(buf, 1, INDEX_ENTRY, in) != INDEX_ENTRY)
+            break;
+        index[i].coff = get64(buf);
+        index[i].uoff = get64(&(buf[8]));
+        index[i].csize = get32(&(buf[16]));
+        index[i].usize = get32(&(buf[20]));
+        if (index[i].coff != coff || index[i].uoff != uoff || index[i].usize > block)
+            break;
+        coff += BLOCK_HEADER + (uint64_t)index[i].csize;
+        uoff += index[i].usize;
+    }
+    if (i < n || coff + BLOCK_HEADER != (uint64_t)start){
+        free(index);
+        return NULL;
+    }
+    
+    *count = n;
+    return index;
+}
+
+/***************************************************************************
+ *                         FRAME ENCODE FUNCTION
+ * Name         : frameEncode - compress a file in the framed format, the
+ *                blocks being compressed by 'threads' workers
+ * Parameters   : in - file to encode
+ *                out - compressed file
+ *                p - encoder parameters, without dictionary: the frame
+ *                    doesn't tell the decoder it needs one
+ *                threads - # of workers
+ * Returned     : 0 on success, -1 on errors
+ ***************************************************************************/
+int frameEncode(FILE *in, FILE *out, const struct lz77_params *p, int threads)
+{
+    /* variables */
+    struct pool pool;
+    struct job *job;
+    pthread_t *tid = NULL;
+    unsigned char header[FRAME_HEADER];
+    struct blockIndex *index = NULL, *tmp;
+    long count = 0, cap = 0;
+    uint64_t coff = FRAME_HEADER, uoff = 0;
+    int i, started = 0, eof = 0, ret = -1;
+    size_t n;
+    
+    if (p->dict != NULL)
+        return -1;
+    
+    /* write the frame header */
+    memcpy(header, magic, sizeof(magic));
+    header[4] = FRAME_VERSION;
+    header[5] = FRAME_INDEX;
+    header[6] = header[7] = 0;
+    put32(&(header[8]), BLOCK_SIZE);
+    if (fwrite(header, 1, FRAME_HEADER, out) != FRAME_HEADER)
+        return -1;
+    
+    /* set up the pool */
+    pool.njobs = threads * JOBS_PER_THREAD;
+    if ((pool.jobs = calloc(pool.njobs, sizeof(struct job))) == NULL)
+        return -1;
+    pool.read = pool.taken = pool.written = 0;
+    pool.stop = 0;
+    pool.params = p;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    
+    for (i = 0; i < pool.njobs; i++){
+        pool.jobs[i].outCap = lz77_compress_bound(BLOCK_SIZE, p->la, p->sb);
+        pool.jobs[i].in = malloc(BLOCK_SIZE);
+        pool.jobs[i].out = malloc(BLOCK_HEADER + pool.jobs[i].outCap);
+        if (pool.jobs[i].in == NULL || pool.jobs[i].out == NULL){
+            /* not advanced yet, the cleanup would miss its start */
+            free(pool.jobs[i].out);
+            pool.jobs[i].out = NULL;
+            goto end;
+        }
+        /* the block header is written in front of the compressed block */
+        pool.jobs[i].out += BLOCK_HEADER;
+    }
+    
+    if ((tid = malloc(threads * sizeof(pthread_t))) == NULL)
+        goto end;
+    for (started = 0; started < threads; started++)
+        if (pthread_create(&(tid[started]), NULL, worker, &pool) != 0)
+            break;
+    if (started == 0)
+        goto end;
+    
+    pthread_mutex_lock(&pool.lock);
+    while (1){
+        /* read blocks as long as there are free jobs */
+        while (!eof && pool.read - pool.written < pool.njobs){
+            job = &(pool.jobs[pool.read % pool.njobs]);
+            
+            /* a free job is not seen by the workers */
+            pthread_mutex_unlock(&pool.lock);
+            n = fread(job->in, 1, BLOCK_SIZE, in);
+            pthread_mutex_lock(&pool.lock);
+            
+            if (ferror(in))
+                goto stop;
+            if (n < BLOCK_SIZE)
+                eof = 1;
+            if (n == 0)
+                break;
+            
+            job->inLen = n;
+            job->state = JOB_READY;
+            pool.read++;
+            pthread_cond_signal(&pool.ready);
+        }
+        
+        if (pool.written == pool.read)
+            break;
+        
+        /* write the oldest block as soon as it is compressed */
+        job = &(pool.jobs[pool.written % pool.njobs]);
+        while (job->state != JOB_DONE)
+            pthread_cond_wait(&pool.done, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+        
+        if (job->outLen == LZ77_ERROR)
+            goto relock;
+        put32(job->out - BLOCK_HEADER, job->inLen);
+        put32(job->out - BLOCK_HEADER + 4, job->outLen);
+        if (fwrite(job->out - BLOCK_HEADER, 1, BLOCK_HEADER + job->outLen, out) != BLOCK_HEADER + job->outLen)
+            goto relock;
+        
+        if (count == cap){
+            cap = cap ? 2 * cap : 64;
+            if ((tmp = realloc(index, cap * sizeof(struct blockIndex))) == NULL)
+                goto relock;
+            index = tmp;
+        }
+        index[count].coff = coff;
+        index[count].uoff = uoff;
+        index[count].csize = job->outLen;
+        index[count].usize = job->inLen;
+        count++;
+        coff += BLOCK_HEADER + job->outLen;
+        uoff += job->inLen;
+        
+        pthread_mutex_lock(&pool.lock);
+        job->state = JOB_FREE;
+        pool.written++;
+    }
+    
+    /* end of the frame */
+    memset(header, 0, BLOCK_HEADER);
+    if (fwrite(header, 1, BLOCK_HEADER, out) == BLOCK_HEADER && writeIndex(out, index, count) == 0)
+        ret = 0;
+    goto stop;
+    
+relock:
+    pthread_mutex_lock(&pool.lock);
+stop:
+    /* let the workers go, the blocks not compressed yet are dropped */
+    pool.stop = 1;
+    pool.read = pool.taken;
+    pthread_cond_broadcast(&pool.ready);
+    pthread_mutex_unlock(&pool.lock);
+    for (i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    
+end:
+    free(tid);
+    for (i = 0; i < pool.njobs; i++){
+        free(pool.jobs[i].in);
+        if (pool.jobs[i].out != NULL)
+            free(pool.jobs[i].out - BLOCK_HEADER);
+    }
+    free(pool.jobs);
+    free(index);
+    pthread_mutex_destroy(&pool.lock);
+    pthread_cond_destroy(&pool.ready);
+    pthread_cond_destroy(&pool.done);
+    
+    return ret;
+}
+
+/***************************************************************************
+ *                          READ HEADER FUNCTION
+ * Name         : readHeader - read and check the frame header, but for the
+ *                magic already read by the caller
+ * Parameters   : in - compressed file, just after the magic
+ *                header - where the header goes
+ *                block - where the max uncompressed size of a block goes
+ * Returned     : 0 on success, -1 if the file is not a valid frame
+ ***************************************************************************/
+static int readHeader(FILE *in, unsigned char *header, size_t *block)
+{
+    memcpy(header, magic, sizeof(magic));
+    if (fread(&(header[sizeof(magic)]), 1, FRAME_HEADER - sizeof(magic), in) != FRAME_HEADER - sizeof(magic))
+        return -1;
+    if (header[4] != FRAME_VERSION)
+        return -1;
+    *block = get32(&(header[8]));
+    if (*block == 0 || *block > MAX_BLOCK_SIZE)
+        return -1;
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                          SCAN INDEX FUNCTION
+ * Name         : scanIndex - build the index of a frame without one, only
+ *                the block headers are read
+ * Parameters   : in - compressed file, just after the frame header
+ *                block - max uncompressed size of a block
+ *                count - where the # of blocks goes
+ * Returned     : the blocks (to be freed), NULL on errors
+ ***************************************************************************/
+static struct blockIndex *scanIndex(FILE *in, size_t block, long *count)
+{
+    unsigned char buf[BLOCK_HEADER];
+    struct blockIndex *index = NULL, *tmp;
+    uint64_t coff = FRAME_HEADER, uoff = 0;
+    long n = 0, cap = 0;
+    
+    while (1){
+        if (fread(buf, 1, BLOCK_HEADER, in) != BLOCK_HEADER)
+            goto fail;
+        if (get32(buf) == 0 && get32(&(buf[4])) == 0)
+            break;
+        
+        if (n == cap){
+            cap = cap ? 2 * cap : 64;
+            if ((tmp = realloc(index, cap * sizeof(struct blockIndex))) == NULL)
+                goto fail;
+            index = tmp;
+        }
+        index[n].coff = coff;
+        index[n].uoff = uoff;
+        index[n].usize = get32(buf);
+        index[n].csize = get32(&(buf[4]));
+        if (index[n].usize > block || fseeko(in, index[n].csize, SEEK_CUR) != 0)
+            goto fail;
+        coff += BLOCK_HEADER + (uint64_t)index[n].csize;
+        uoff += index[n].usize;
+        n++;
+    }
+    
+    if (index == NULL && (index = malloc(sizeof(struct blockIndex))) == NULL)
+        return NULL;
+    *count = n;
+    return index;
+    
+fail:
+    free(index);
+    return NULL;
+}
+
+/***************************************************************************
+ *                         FULL PREAD AND PWRITE
+ ***************************************************************************/
+static int preadFull(int fd, void *buf, size_t len, off_t off)
+{
+    ssize_t n;
+    
+    while (len > 0){
+        if ((n = pread(fd, buf, len, off)) <= 0)
+            return -1;
+        buf = (unsigned char *)buf + n;
+        len -= n;
+        off += n;
+    }
+    
+    return 0;
+}
+
+static int pwriteFull(int fd, const void *buf, size_t len, off_t off)
+{
+    ssize_t n;
+    
+    while (len > 0){
+        if ((n = pwrite(fd, buf, len, off)) <= 0)
+            return -1;
+        buf = (const unsigned char *)buf + n;
+        len -= n;
+        off += n;
+    }
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                         DECODE WORKER FUNCTION
+ * Name         : decodeWorker - decompress blocks of the index, each one is
+ *                written at its offset in the output
+ * Parameters   : arg - the pool
+ ***************************************************************************/
+static void *decodeWorker(void *arg)
+{
+    struct decodePool *pool = arg;
+    const struct blockIndex *b;
+    unsigned char *cbuf = NULL, *ubuf;
+    size_t ccap = 0;
+    long i;
+    
+    if ((ubuf = malloc(pool->block)) == NULL)
+        goto fail;
+    
+    while (1){
+        pthread_mutex_lock(&pool->lock);
+        if (pool->err || pool->next == pool->count){
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        
+        b = &(pool->index[i]);
+        if (b->csize > ccap){
+            free(cbuf);
+            ccap = b->csize;
+            if ((cbuf = malloc(ccap)) == NULL)
+                goto fail;
+        }
+        if (preadFull(pool->fdIn, cbuf, b->csize, b->coff + BLOCK_HEADER) < 0)
+            goto fail;
+        if (lz77_decompress(cbuf, b->csize, ubuf, b->usize) != b->usize)
+            goto fail;
+        if (pwriteFull(pool->fdOut, ubuf, b->usize, b->uoff) < 0)
+            goto fail;
+    }
+    
+    free(cbuf);
+    free(ubuf);
+    STATS_MERGE();
+    return NULL;
+    
+fail:
+    pthread_mutex_lock(&pool->lock);
+    pool->err = 1;
+    pthread_mutex_unlock(&pool->lock);
+    free(cbuf);
+    free(ubuf);
+    STATS_MERGE();
+    return NULL;
+}
+
+/***************************************************************************
+ *                       PARALLEL DECODE FUNCTION
+ * Name         : parallelDecode - decompress the blocks of the index with
+ *                'threads' workers
+ * Parameters   : in - compressed file
+ *                out - output file, it must be a regular file
+ *                index - the blocks
+ *                count - # of blocks
+ *                block - max uncompressed size of a block
+ *                threads - # of workers
+ * Returned     : 0 on success, -1 if the file is corrupted or on errors
+ ***************************************************************************/
+static int parallelDecode(FILE *in, FILE *out, const struct blockIndex *index, long count, size_t block, int threads)
+{
+    struct decodePool pool;
+    pthread_t *tid;
+    int i, started;
+    
+    pool.index = index;
+    pool.count = count;
+    pool.next = 0;
+    pool.block = block;
+    pool.fdIn = fileno(in);
+    pool.fdOut = fileno(out);
+    pool.err = 0;
+    pthread_mutex_init(&pool.lock, NULL);
+    
+    if ((tid = malloc(threads * sizeof(pthread_t))) == NULL)
+        return -1;
+    for (started = 0; started < threads; started++)
+        if (pthread_create(&(tid[started]), NULL, decodeWorker, &pool) != 0)
+            break;
+    /* with no worker at all, the main thread does the job */
+    if (started == 0)
+        decodeWorker(&pool);
+    for (i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    
+    free(tid);
+    pthread_mutex_destroy(&pool.lock);
+    
+    return pool.err ? -1 : 0;
+}
+
+/***************************************************************************
+ *                         FRAME DECODE FUNCTION
+ * Name         : frameDecode - decompress a file in the framed format. If
+ *                the frame has an index and both files are regular ones,
+ *                the blocks are decompressed by 'threads' workers
+ * Parameters   : in - compressed file, just after the magic (frameProbe)
+ *                out - output file
+ *                threads - # of workers, 0 to decompress in order
+ * Returned     : 0 on success, -1 if the file is corrupted or on errors
+ ***************************************************************************/
+int frameDecode(FILE *in, FILE *out, int threads)
+{
+    /* variables */
+    unsigned char header[FRAME_HEADER];
+    unsigned char *cbuf = NULL, *ubuf = NULL;
+    size_t block, usize, csize, ccap;
+    struct blockIndex *index;
+    struct stat st, sto;
+    long count;
+    int ret = -1;
+    
+    if (readHeader(in, header, &block) < 0)
+        return -1;
+    
+    /* the index is found by seeking, blocks are written at their offset */
+    if (threads > 0 && (header[5] & FRAME_INDEX) && fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode)
+        && fstat(fileno(out), &sto) == 0 && S_ISREG(sto.st_mode)){
+        if ((index = readIndex(in, block, &count)) == NULL)
+            return -1;
+        ret = parallelDecode(in, out, index, count, block, threads);
+        free(index);
+        return ret;
+    }
+    
+    /* the compressed buffer grows as needed */
+    if ((ubuf = malloc(block)) == NULL)
+        return -1;
+    ccap = 0;
+    
+    while (1){
+        if (fread(header, 1, BLOCK_HEADER, in) != BLOCK_HEADER)
+            goto end;
+        usize = get32(header);
+        csize = get32(&(header[4]));
+        
+        /* end of the frame */
+        if (usize == 0 && csize == 0)
+            break;
+        if (usize > block)
+            goto end;
+        
+        if (csize > ccap){
+            free(cbuf);
+            ccap = csize;
+            if ((cbuf = malloc(ccap)) == NULL)
+                goto end;
+        }
+        if (fread(cbuf, 1, csize, in) != csize)
+            goto end;
+        
+        if (lz77_decompress(cbuf, csize, ubuf, usize) != usize)
+            goto end;
+        if (fwrite(ubuf, 1, usize, out) != usize)
+            goto end;
+    }
+    ret = 0;
+    
+end:
+    free(cbuf);
+    free(ubuf);
+    return ret;
+}
+
+/***************************************************************************
+ *                          DECODE RANGE FUNCTION
+ * Name         : decodeRange - decompress only the blocks covering 'len'
+ *                bytes from 'start' of the data, found by the index
+ * Parameters   : in - compressed file, it must be seekable
+ *                start - offset of the range in the data
+ *                len - size of the range
+ *                out - output file, or NULL
+ *                dst - where the range goes if 'out' is NULL
+ * Returned     : # of bytes of the range (less than 'len' if it goes past
+ *                the end of the data), LZ77_ERROR on errors
+ ***************************************************************************/
+static size_t decodeRange(FILE *in, uint64_t start, size_t len, FILE *out, unsigned char *dst)
+{
+    /* variables */
+    unsigned char header[FRAME_HEADER];
+    unsigned char *cbuf = NULL, *ubuf = NULL;
+    struct blockIndex *index;
+    size_t block, ccap = 0, skip, n, done = 0;
+    long count, lo, hi, i;
+    
+    if (fseeko(in, sizeof(magic), SEEK_SET) != 0 || readHeader(in, header, &block) < 0)
+        return LZ77_ERROR;
+    if (header[5] & FRAME_INDEX)
+        index = readIndex(in, block, &count);
+    else
+        index = scanIndex(in, block, &count);
+    if (index == NULL)
+        return LZ77_ERROR;
+    
+    /* the first block ending after 'start' */
+    lo = 0;
+    hi = count;
+    while (lo < hi){
+        i = lo + (hi - lo) / 2;
+        if (index[i].uoff + index[i].usize <= start)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    
+    if ((ubuf = malloc(block)) == NULL)
+        goto fail;
+    
+    for (i = lo; i < count && done < len; i++){
+        if (index[i].csize > ccap){
+            free(cbuf);
+            ccap = index[i].csize;
+            if ((cbuf = malloc(ccap)) == NULL)
+                goto fail;
+        }
+        if (fseeko(in, index[i].coff + BLOCK_HEADER, SEEK_SET) != 0 || fread(cbuf, 1, index[i].csize, in) != index[i].csize)
+            goto fail;
+        if (lz77_decompress(cbuf, index[i].csize, ubuf, index[i].usize) != index[i].usize)
+            goto fail;
+        
+        /* the part of the block in the range */
+        skip = (start > index[i].uoff) ? start - index[i].uoff : 0;
+        n = index[i].usize - skip;
+        if (n > len - done)
+            n = len - done;
+        if (out != NULL){
+            if (fwrite(ubuf + skip, 1, n, out) != n)
+                goto fail;
+        }else
+            memcpy(dst + done, ubuf + skip, n);
+        done += n;
+    }
+    
+    free(index);
+    free(cbuf);
+    free(ubuf);
+    return done;
+    
+fail:
+    free(index);
+    free(cbuf);
+    free(ubuf);
+    return LZ77_ERROR;
+}
+
+/***************************************************************************
+ *                        FRAME DECODE RANGE FUNCTION
+ * Name         : frameDecodeRange - decompress 'len' bytes from 'start' of
+ *                a framed file into another file
+ * Parameters   : in - compressed file, it must be seekable
+ *                out - output file
+ *                start - offset of the range in the data
+ *                len - size of the range
+ * Returned     : # of bytes written (less than 'len' if the range goes past
+ *                the end of the data), LZ77_ERROR on errors
+ ***************************************************************************/
+size_t frameDecodeRange(FILE *in, FILE *out, uint64_t start, size_t len)
+{
+    return decodeRange(in, start, len, out, NULL);
+}
+
+/***************************************************************************
+ *                         FRAME READ RANGE FUNCTION
+ * Name         : frameReadRange - decompress 'len' bytes from 'start' of a
+ *                framed file into memory
+ * Parameters   : in - compressed file, it must be seekable
+ *                start - offset of the range in the data
+ *                dst - where the range goes, at least 'len' bytes
+ *                len - size of the range
+ * Returned     : # of bytes read (less than 'len' if the range goes past
+ *                the end of the data), LZ77_ERROR on errors
+ ***************************************************************************/
+size_t frameReadRange(FILE *in, uint64_t start, void *dst, size_t len)
+{
+    return decodeRange(in, start, len, NULL, dst);
+}
@@ -0,0 +1,23 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : frame.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef frame_h
+#define frame_h
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define FRAME_MAGIC_SIZE 4      /* bytes looked at by frameProbe */
+
+/***************************************************************************
+ *                         FUNCTIONS DECLARATION
+ ***************************************************************************/
+int frameProbe(const unsigned char *head, size_t n);
+int frameEncode(FILE *in, FILE *out, const struct lz77_params *p, int threads);
+int frameDecode(FILE *in, FILE *out, int threads);
+size_t frameDecodeRange(FILE *in, FILE *out, uint64_t start, size_t len);
+size_t frameReadRange(FILE *in, uint64_t start, void *dst, size_t len);
+#endif
@@ -0,0 +1,237 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : hash.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdlib.h>
+#include "alloc.h"
+#include "tree.h"
+#include "hash.h"
+#include "lcp.h"
+#include "stats.h"
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define HASH_BITS 16
+#define HASH_SIZE (1 << HASH_BITS)
+#define HASH_MIN 2          /* # of bytes hashed, shorter matches are missed */
+#define NIL 0                /* no position: always out of the search buffer */
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ * The hash chain keeps, for each hash of HASH_MIN bytes, the last position
+ * where it was seen (head) and, for each position of the search buffer, the
+ * previous one with the same hash (prev). Positions are absolute (they never
+ * change when the window is scrolled): a position is at '(pos - base) &
+ * wmask' in the ring buffer, whose first byte is at 'base'. The chains are
+ * never cleaned: a position is dropped as soon as it falls out of the search
+ * buffer. The encoder's positions start above the search buffer size, so
+ * that NIL is always out of it.
+ ***************************************************************************/
+struct hashChain{
+    unsigned int *head; /* last position of each hash */
+    unsigned int *prev; /* previous position with the same hash */
+    unsigned int last[256]; /* last position of each byte value */
+    unsigned int mask;  /* prev has mask + 1 >= search buffer size entries */
+    unsigned int size;  /* search buffer size */
+    int depth;          /* max # of positions visited by a find */
+    const struct lz77_alloc *alloc; /* where the memory comes from */
+};
+
+/***************************************************************************
+ *                            HASH FUNCTION
+ * Name         : hashOf - hash of the first HASH_MIN bytes of a sequence.
+ *                Every token carries the next char, so even a 2 bytes match
+ *                is worth finding: the 2 bytes themselves are the hash.
+ * Parameters   : p - pointer to the sequence
+ * Returned     : index in the head table
+ ***************************************************************************/
+static inline int hashOf(const unsigned char *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+/***************************************************************************
+ *                          CREATE HASH FUNCTION
+ * Name         : createHash - memory allocation for the hash chain
+ * Parameters   : size - search buffer size
+ *                depth - max # of positions visited by a find
+ *                a - allocator, NULL for malloc
+ * Returned     : pointer to the hash chain, NULL if there is no memory
+ ***************************************************************************/
+struct hashChain *createHash(int size, int depth, const struct lz77_alloc *a)
+{
+    int i, n = 1;
+    struct hashChain *hash = memCalloc(a, sizeof(struct hashChain));
+    
+    if (hash == NULL)
+        return NULL;
+    /* power of two, so that a position is mapped in prev by masking */
+    while (n < size)
+        n <<= 1;
+    
+    hash->alloc = a;
+    hash->head = memAlloc(a, HASH_SIZE * sizeof(unsigned int));
+    hash->prev = memAlloc(a, n * sizeof(unsigned int));
+    if (hash->head == NULL || hash->prev == NULL){
+        destroyHash(hash);
+        return NULL;
+    }
+    hash->mask = n - 1;
+    hash->size = size;
+    hash->depth = depth;
+    
+    for (i = 0; i < HASH_SIZE; i++)
+        hash->head[i] = NIL;
+    for (i = 0; i < 256; i++)
+        hash->last[i] = NIL;
+    
+    return hash;
+}
+
+/***************************************************************************
+ *                        DESTROY HASH FUNCTION
+ * Name         : destroyHash - memory deallocation of the hash chain
+ * Parameters   : hash - pointer to the hash chain
+ ***************************************************************************/
+void destroyHash(struct hashChain *hash)
+{
+    memFree(hash->alloc, hash->head);
+    memFree(hash->alloc, hash->prev);
+    memFree(hash->alloc, hash);
+}
+
+/***************************************************************************
+ *                          HASH INSERT FUNCTION
+ * Name         : hashInsert - insert a position at the head of its chain
+ * Parameters   : hash - pointer to the hash chain
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                base - position of window[0]
+ *                pos - absolute position of the sequence
+ *                size - available bytes from pos (actual lookahead size)
+ ***************************************************************************/
+void hashInsert(struct hashChain *hash, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size)
+{
+    int h;
+    unsigned char *cur = &(window[(pos - base) & wmask]);
+    
+    /* too close to the end of the data to be hashed */
+    if (size < HASH_MIN)
+        return;
+    
+    hash->last[cur[0]] = pos;
+    STATS_DEPTH(insert, 0);
+    
+    h = hashOf(cur);
+    hash->prev[pos & hash->mask] = hash->head[h];
+    hash->head[h] = pos;
+}
+
+/***************************************************************************
+ *                           HASH FIND FUNCTION
+ * Name         : hashFind - find the longest match walking the chain of
+ *                the lookahead's hash, for at most 'depth' positions
+ * Parameters   : hash - pointer to the hash chain
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                base - position of window[0]
+ *                pos - absolute position of the lookahead
+ *                size - actual lookahead size
+ *                all - where the longer and longer matches met go, NULL
+ *                      if only the longest one is wanted
+ * Returned     : best match's offset and length
+ ***************************************************************************/
+struct ret hashFind(struct hashChain *hash, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size,
+                    struct matches *all)
+{
+    /* variables */
+    int i, depth;
+    unsigned int cand;
+    unsigned char *cur = &(window[(pos - base) & wmask]), *seq;
+    struct ret off_len;
+    STATS_LOCAL(visited);
+    
+    /* initialize as non-match values */
+    off_len.off = 0;
+    off_len.len = 0;
+    if (all != NULL)
+        all->n = 0;
+    
+    if (size < HASH_MIN)
+        return off_len;
+    
+    /* a 1 byte match is still worth a token, if nothing longer is found */
+    cand = hash->last[cur[0]];
+    if (pos - cand <= hash->size){
+        off_len.off = pos - cand;
+        off_len.len = 1;
+        addMatch(all, off_len.off, 1);
+    }
+    
+    cand = hash->head[hashOf(cur)];
+    
+    for (depth = hash->depth; depth > 0; depth--){
+        
+        /* the rest of the chain is out of the search buffer (or empty) */
+        if (pos - cand > hash->size)
+            break;
+        
+        seq = &(window[(cand - base) & wmask]);
+        STATS_INC(visited);
+        
+        /* it can't be better if it differs on the byte that would make it so */
+        if (seq[off_len.len] == cur[off_len.len]){
+            i = matchLength(cur, seq, size-1);
+            STATS_ADD(cmpBytes, i + 1);
+            
+            if (i > off_len.len){
+                off_len.off = pos - cand;
+                off_len.len = i;
+                addMatch(all, off_len.off, i);
+                
+                /* can't do better than the whole lookahead */
+                if (i == size-1)
+                    break;
+            }
+        }
+        
+        cand = hash->prev[cand & hash->mask];
+    }
+    STATS_DEPTH(find, visited);
+    
+    return off_len;
+}
+
+/* subtract 'n' from a position, the ones older than 'n' become NIL */
+static inline unsigned int sub(unsigned int pos, unsigned int n)
+{
+    return (pos > n) ? (pos - n) : NIL;
+}
+
+/***************************************************************************
+ *                        HASH NORMALIZE FUNCTION
+ * Name         : hashNormalize - bring the positions back before they
+ *                overflow (once every couple of GB); positions older than
+ *                'n' are out of the search buffer anyway and become NIL
+ * Parameters   : hash - pointer to the hash chain
+ *                n - value to subtract, a multiple of the prev size
+ ***************************************************************************/
+void hashNormalize(struct hashChain *hash, unsigned int n)
+{
+    unsigned int i;
+    
+    for (i = 0; i < HASH_SIZE; i++)
+        hash->head[i] = sub(hash->head[i], n);
+    for (i = 0; i <= hash->mask; i++)
+        hash->prev[i] = sub(hash->prev[i], n);
+    for (i = 0; i < 256; i++)
+        hash->last[i] = sub(hash->last[i], n);
+}
@@ -0,0 +1,25 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : hash.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef hash_h
+#define hash_h
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ ***************************************************************************/
+struct hashChain;
+struct matches;
+
+/***************************************************************************
+ *                         FUNCTIONS DECLARATION
+ ***************************************************************************/
+struct hashChain *createHash(int size, int depth, const struct lz77_alloc *a);
+void destroyHash(struct hashChain *hash);
+void hashInsert(struct hashChain *hash, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size);
+struct ret hashFind(struct hashChain *hash, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int pos, int size,
+                    struct matches *all);
+void hashNormalize(struct hashChain *hash, unsigned int n);
+#endif
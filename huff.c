@@ -0,0 +1,166 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : huff.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ *   Canonical Huffman codes, limited to HUFF_MAX_BITS bits. A code is sent
+ *   as the length of the code of each symbol: the codes themselves are
+ *   given in order of length, and of symbol among the same length.
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdint.h>
+#include <string.h>
+#include "huff.h"
+
+/***************************************************************************
+ *                          HUFF LENGTHS FUNCTION
+ * Name         : huffLengths - lengths of the Huffman code of the symbols,
+ *                at most HUFF_MAX_BITS bits. The tree is built with two
+ *                queues over the symbols sorted by frequency; too long codes
+ *                are cut to HUFF_MAX_BITS and the shortest of the others are
+ *                lengthened until the code is valid again.
+ * Parameters   : freq - frequency of each symbol
+ *                nsym - # of symbols
+ *                len - where the lengths go, 0 for unused symbols
+ ***************************************************************************/
+void huffLengths(const unsigned int *freq, int nsym, unsigned char *len)
+{
+    /* variables */
+    int sym[HUFF_MAX_SYMBOLS];
+    unsigned int weight[2 * HUFF_MAX_SYMBOLS];
+    int parent[2 * HUFF_MAX_SYMBOLS], depth[2 * HUFF_MAX_SYMBOLS];
+    int i, j, n = 0, leaf, node, next, a, b, s;
+    unsigned int kraft;
+    
+    memset(len, 0, nsym);
+    for (i = 0; i < nsym; i++)
+        if (freq[i] > 0)
+            sym[n++] = i;
+    if (n == 0)
+        return;
+    if (n == 1){
+        len[sym[0]] = 1;
+        return;
+    }
+    
+    /* sort the used symbols by frequency (few hundreds at most) */
+    for (i = 1; i < n; i++){
+        s = sym[i];
+        for (j = i; j > 0 && freq[sym[j - 1]] > freq[s]; j--)
+            sym[j] = sym[j - 1];
+        sym[j] = s;
+    }
+    for (i = 0; i < n; i++)
+        weight[i] = freq[sym[i]];
+    
+    /* the leaves are 0..n-1 and the nodes n..2n-2, both made in order of
+       weight: the two lightest are always at the front of either queue */
+    leaf = 0;
+    node = n;
+    for (next = n; next < 2 * n - 1; next++){
+        a = (leaf < n && (node == next || weight[leaf] <= weight[node])) ? leaf++ : node++;
+        b = (leaf < n && (node == next || weight[leaf] <= weight[node])) ? leaf++ : node++;
+        weight[next] = weight[a] + weight[b];
+        parent[a] = parent[b] = next;
+    }
+    
+    depth[2 * n - 2] = 0;
+    for (i = 2 * n - 3; i >= 0; i--)
+        depth[i] = depth[parent[i]] + 1;
+    
+    /* cut the long codes, the rarest symbols are the first ones */
+    kraft = 0;
+    for (i = 0; i < n; i++){
+        len[sym[i]] = (depth[i] > HUFF_MAX_BITS) ? HUFF_MAX_BITS : depth[i];
+        kraft += 1U << (HUFF_MAX_BITS - len[sym[i]]);
+    }
+    
+    /* lengthen the longest codes shorter than the max, of the rarest
+       symbols, until the code fits */
+    while (kraft > (1U << HUFF_MAX_BITS)){
+        for (s = HUFF_MAX_BITS - 1; s > 0; s--){
+            for (i = 0; i < n && len[sym[i]] != s; i++){}
+            if (i < n)
+                break;
+        }
+        len[sym[i]]++;
+        kraft -= 1U << (HUFF_MAX_BITS - len[sym[i]]);
+    }
+}
+
+/***************************************************************************
+ *                           HUFF CODES FUNCTION
+ * Name         : huffCodes - canonical codes of the given lengths
+ * Parameters   : c - code, with the lengths set
+ *                nsym - # of symbols
+ ***************************************************************************/
+void huffCodes(struct huffCode *c, int nsym)
+{
+    int count[HUFF_MAX_BITS + 1] = {0};
+    unsigned int next[HUFF_MAX_BITS + 1];
+    unsigned int code, rev;
+    int i, l;
+    
+    for (i = 0; i < nsym; i++)
+        count[c->len[i]]++;
+    count[0] = 0;
+    
+    code = 0;
+    for (l = 1; l <= HUFF_MAX_BITS; l++){
+        code = (code + count[l - 1]) << 1;
+        next[l] = code;
+    }
+    
+    for (i = 0; i < nsym; i++){
+        if ((l = c->len[i]) == 0)
+            continue;
+        code = next[l]++;
+        for (rev = 0; l > 0; l--, code >>= 1)
+            rev = (rev << 1) | (code & 1);
+        c->code[i] = rev;
+    }
+}
+
+/***************************************************************************
+ *                           HUFF TABLE FUNCTION
+ * Name         : huffTable - decoding table of the code of given lengths.
+ *                A code may be incomplete (a single symbol, no symbol): the
+ *                missing entries have length 0
+ * Parameters   : t - decoding table
+ *                len - lengths of the code of the symbols
+ *                nsym - # of symbols
+ * Returned     : 0 on success, -1 if the lengths aren't a prefix code
+ ***************************************************************************/
+int huffTable(struct huffTable *t, const unsigned char *len, int nsym)
+{
+    struct huffCode c;
+    unsigned int kraft = 0;
+    int i, k, l;
+    
+    for (i = 0; i < nsym; i++){
+        if (len[i] > HUFF_MAX_BITS)
+            return -1;
+        if (len[i] > 0)
+            kraft += 1U << (HUFF_MAX_BITS - len[i]);
+    }
+    if (kraft > (1U << HUFF_MAX_BITS))
+        return -1;
+    
+    memcpy(c.len, len, nsym);
+    huffCodes(&c, nsym);
+    
+    /* a code of 'l' bits fills all the entries ending with it */
+    memset(t->entry, 0, sizeof(t->entry));
+    for (i = 0; i < nsym; i++){
+        if ((l = len[i]) == 0)
+            continue;
+        for (k = c.code[i]; k < (1 << HUFF_MAX_BITS); k += 1 << l)
+            t->entry[k] = (i << 4) | l;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : huff.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef huff_h
+#define huff_h
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define HUFF_MAX_BITS 12        /* max length of a code */
+#define HUFF_MAX_SYMBOLS 512    /* max size of an alphabet */
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ * Codes are written LSB first, as every field of the stream: the code of a
+ * symbol is stored bit-reversed, so that the decoder looks the next
+ * HUFF_MAX_BITS bits of the stream up in a table of symbol and length.
+ ***************************************************************************/
+struct huffCode{
+    unsigned short code[HUFF_MAX_SYMBOLS];  /* bit-reversed codes */
+    unsigned char len[HUFF_MAX_SYMBOLS];    /* their lengths, 0 if unused */
+};
+
+struct huffTable{
+    unsigned short entry[1 << HUFF_MAX_BITS];   /* symbol << 4 | length */
+};
+
+/***************************************************************************
+ *                         FUNCTIONS DECLARATION
+ ***************************************************************************/
+void huffLengths(const unsigned int *freq, int nsym, unsigned char *len);
+void huffCodes(struct huffCode *c, int nsym);
+int huffTable(struct huffTable *t, const unsigned char *len, int nsym);
+
+/***************************************************************************
+ *                          HUFF DECODE FUNCTION
+ * Name         : huffDecode - decode a symbol from the next bits
+ * Parameters   : t - decoding table
+ *                bits - next bits of the stream, LSB first
+ *                sym - where the symbol goes
+ * Returned     : length of its code, 0 if the bits are no code
+ ***************************************************************************/
+static inline int huffDecode(const struct huffTable *t, uint64_t bits, int *sym)
+{
+    unsigned int e = t->entry[bits & ((1 << HUFF_MAX_BITS) - 1)];
+    
+    *sym = e >> 4;
+    return e & 0xF;
+}
+#endif
@@ -0,0 +1,150 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : lcp.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ *   Kernels of the long matches of matchLength (see lcp.h): 64 bytes at a
+ *   time with AVX2, 16 with SSE2, 8 with a 64 bits XOR elsewhere. The
+ *   kernel is chosen at the first call from what the CPU supports, so that
+ *   the same binary runs everywhere.
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdint.h>
+#include <string.h>
+#include "lcp.h"
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define LCP_X86
+#endif
+
+#ifdef LCP_X86
+/***************************************************************************
+ *                           LCP SSE2 FUNCTION
+ * Name         : lcpSse2 - compare 16 bytes at a time: the mask of the
+ *                bytes which differ gives the mismatch by its trailing zeros.
+ *                The last bytes are compared with the 16 bytes ending at
+ *                'max', which overlap the ones known to be equal.
+ * Parameters   : a, b - the sequences
+ *                i - # of bytes already known to be equal
+ *                max - max length, at least 16
+ * Returned     : # of equal bytes, at most max
+ ***************************************************************************/
+static int lcpSse2(const unsigned char *a, const unsigned char *b, int i, int max)
+{
+    __m128i x, y;
+    unsigned int ne;
+    
+    for (; i + 16 <= max; i += 16){
+        x = _mm_loadu_si128((const __m128i *)(a + i));
+        y = _mm_loadu_si128((const __m128i *)(b + i));
+        ne = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+        if (ne != 0)
+            return i + __builtin_ctz(ne);
+    }
+    if (i == max)
+        return max;
+    
+    x = _mm_loadu_si128((const __m128i *)(a + max - 16));
+    y = _mm_loadu_si128((const __m128i *)(b + max - 16));
+    ne = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+    
+    return (ne != 0) ? max - 16 + __builtin_ctz(ne) : max;
+}
+
+/***************************************************************************
+ *                           LCP AVX2 FUNCTION
+ * Name         : lcpAvx2 - compare 64 bytes a round, the masks of their two
+ *                halves tested at once, then the last 32 (or 64) bytes as
+ *                lcpSse2. It doesn't call the SSE2 kernel for them: legacy
+ *                SSE code after AVX code which didn't clear the upper halves
+ *                of the registers runs many times slower.
+ * Parameters   : a, b - the sequences
+ *                i - # of bytes already known to be equal
+ *                max - max length, at least 32
+ * Returned     : # of equal bytes, at most max
+ ***************************************************************************/
+__attribute__((target("avx2")))
+static int lcpAvx2(const unsigned char *a, const unsigned char *b, int i, int max)
+{
+    __m256i x, y;
+    unsigned int ne;
+    
+    for (; max - i > 64; i += 64){
+        x = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+        y = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 32)), _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+        if ((unsigned int)_mm256_movemask_epi8(_mm256_and_si256(x, y)) != 0xFFFFFFFFU){
+            ne = ~(unsigned int)_mm256_movemask_epi8(x);
+            if (ne != 0)
+                return i + __builtin_ctz(ne);
+            
+            return i + 32 + __builtin_ctz(~(unsigned int)_mm256_movemask_epi8(y));
+        }
+    }
+    if (max - i > 32){
+        x = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+        ne = ~(unsigned int)_mm256_movemask_epi8(x);
+        if (ne != 0)
+            return i + __builtin_ctz(ne);
+    }
+    
+    x = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + max - 32)), _mm256_loadu_si256((const __m256i *)(b + max - 32)));
+    ne = ~(unsigned int)_mm256_movemask_epi8(x);
+    
+    return (ne != 0) ? max - 32 + __builtin_ctz(ne) : max;
+}
+#else
+/***************************************************************************
+ *                          LCP WORDS FUNCTION
+ * Name         : lcpWords - compare 8 bytes at a time, then 1 byte at a time
+ * Parameters   : a, b - the sequences
+ *                i - # of bytes already known to be equal
+ *                max - max length
+ * Returned     : # of equal bytes, at most max
+ ***************************************************************************/
+static int lcpWords(const unsigned char *a, const unsigned char *b, int i, int max)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t x, y;
+    
+    for (; i + 8 <= max; i += 8){
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y)
+            return i + (__builtin_ctzll(x ^ y) >> 3);
+    }
+#endif
+    for (; i < max && a[i] == b[i]; i++){}
+    
+    return i;
+}
+#endif
+
+/***************************************************************************
+ *                          LCP RESOLVE FUNCTION
+ * Name         : lcpResolve - choose the kernel at the first call. Threads
+ *                racing here all store the same kernel.
+ * Parameters   : a, b - the sequences
+ *                i - # of bytes already known to be equal
+ *                max - max length
+ * Returned     : # of equal bytes, at most max
+ ***************************************************************************/
+static int lcpResolve(const unsigned char *a, const unsigned char *b, int i, int max)
+{
+#ifdef LCP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        matchLengthLong = lcpAvx2;
+    else
+        matchLengthLong = lcpSse2;
+#else
+    matchLengthLong = lcpWords;
+#endif
+    
+    return matchLengthLong(a, b, i, max);
+}
+
+int (*matchLengthLong)(const unsigned char *a, const unsigned char *b, int i, int max) = lcpResolve;
@@ -0,0 +1,64 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : lcp.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef lcp_h
+#define lcp_h
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdint.h>
+#include <string.h>
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define LCP_SHORT 32            /* from this length on, the kernel of lcp.c */
+
+/***************************************************************************
+ *                         FUNCTIONS DECLARATION
+ ***************************************************************************/
+extern int (*matchLengthLong)(const unsigned char *a, const unsigned char *b, int i, int max);
+
+/***************************************************************************
+ *                         MATCH LENGTH FUNCTION
+ * Name         : matchLength - length of the common prefix of two sequences,
+ *                the position of their first mismatch. Short sequences are
+ *                compared 8 bytes at a time, the XOR of two words giving the
+ *                mismatch by its trailing zeros, the last word overlapping
+ *                the ones before; from LCP_SHORT bytes on the widest kernel
+ *                of the CPU is worth its call (see lcp.c). Nothing is read
+ *                past 'max' bytes.
+ * Parameters   : a, b - the sequences
+ *                max - max length
+ * Returned     : # of equal bytes, at most max
+ ***************************************************************************/
+static inline int matchLength(const unsigned char *a, const unsigned char *b, int max)
+{
+    int i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t x, y;
+    
+    if (max >= LCP_SHORT)
+        return matchLengthLong(a, b, 0, max);
+    for (; i + 8 <= max; i += 8){
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        if (x != y)
+            return i + (__builtin_ctzll(x ^ y) >> 3);
+    }
+    if (i < max && max >= 8){
+        memcpy(&x, a + max - 8, 8);
+        memcpy(&y, b + max - 8, 8);
+        
+        return (x != y) ? max - 8 + (__builtin_ctzll(x ^ y) >> 3) : max;
+    }
+#endif
+    for (; i < max && a[i] == b[i]; i++){}
+    
+    return i;
+}
+#endif
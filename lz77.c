@@ -9,38 +9,323 @@
 /***************************************************************************
  *                             INCLUDED FILES
  ***************************************************************************/
+#define _FILE_OFFSET_BITS 64
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "bitio.h"
 #include "tree.h"
+#include "hash.h"
+#include "bt.h"
+#include "huff.h"
+#include "checksum.h"
+#include "stats.h"
+#include "alloc.h"
+#include "lz77.h"
 
 /***************************************************************************
  *                                CONSTANTS
  ***************************************************************************/
 #define DEFAULT_LA_SIZE 15      /* lookahead size */
 #define DEFAULT_SB_SIZE 4095    /* search buffer size */
-#define N 3
+#define DEFAULT_DEPTH 32        /* max hash chain (binary tree) depth */
 #define MAX_BIT_BUFFER 16
+#define DECODE_BLOCK (1 << 20)      /* output written at once by the decoder */
+#define COPY_SLACK 16               /* bytes overwritten past a wide copy */
+#define PUT_SLACK 8                 /* bytes overwritten past the output by putBits */
+#define MIN_WINDOW_SIZE (1 << 16)   /* min size of the encoder's ring buffer */
+#define NORMALIZE_POS 0x80000000U   /* positions are brought back from here */
+#define STREAM_BUFFER (1 << 16)     /* output buffer of the streaming encoder */
+#define STREAM_HUFFMAN 0x01         /* header flag: the tokens are entropy coded */
+#define STREAM_WIDE 0x02            /* header flag: the sizes follow, 32 and 16 bits */
+#define STREAM_DICT 0x04            /* header flag: the ID of a preset dictionary follows */
+#define STREAM_STORED 0x08          /* header flag: the tokens are in blocks, which may be stored */
+#define STREAM_CHECKSUM 0x80        /* header flag: a checksum follows each block, and the stream */
+#define STREAM_FORMAT_SHIFT 4       /* the token format is in bits 4-6 of the flags */
+#define STREAM_FORMAT_MASK 0x7
+#define HEADER_MAX_LA 255           /* largest sizes of the 32 bits header */
+#define HEADER_MAX_SB 65535
+#define WIDE_SB_BITS 32             /* bits of the sizes of a wide header */
+#define WIDE_LA_BITS 16
+#define DICT_ID_BITS 32             /* bits of the dictionary ID, after the sizes */
+#define SUM_BITS 32                 /* bits of a checksum, a CRC-32C */
+#define WINDOW_READ (1 << 20)       /* input read at once into a large window */
+#define VIEW_STEP (1 << 24)         /* input of a view given at once to the encoder */
+#define HUFF_BLOCK (1 << 15)        /* max # of tokens of a Huffman block */
+#define BLOCK_COUNT_BITS 16         /* bits of the # of tokens of a block */
+#define STORED_BLOCK (1 << 15)      /* input of a segment, sampled at once */
+#define STORED_LEN_BITS 16          /* bits of the size of a stored block, minus one */
+#define STORED_MAX (1 << STORED_LEN_BITS)   /* largest stored block */
+#define PROBE_BITS 12               /* bits of the hash of the sampling table */
+#define STORED_GAIN 32              /* a segment saving less than 1/32 is stored */
+#define LENGTH_BITS 4               /* bits of a code length in the tables */
+#define MAX_OFF_SYMBOLS 32          /* offset buckets, one per bit length */
+#define MIN_LEVEL 1
+#define MAX_LEVEL 9
+#define DEFAULT_LEVEL 5
+#define LAZY_OPTIMAL (1 << 30)      /* price the parses, see parseOptimal */
+#define OPT_SPAN (1 << 12)          /* positions parsed at once, at least */
+#define OPT_NICE 128                /* a match so long is taken at once */
+#define OPT_PRICED 1024             /* tokens of a block priced by its own codes */
+#define CODEC_GENERIC 0             /* token codecs, see tokenCodec */
+#define CODEC_12_4 1
+#define CODEC_16_8 2
 
 /***************************************************************************
  *                            TYPE DEFINITIONS
  * Each token is composed by a backward offset, the match's length and the
  * next character in the lookahead.
  * Offset : [0, SB_SIZE]            Length : [0, LA_SIZE]
+ * In the LZ77_FLAGGED format a token is either a literal (length 0 and the
+ * char in 'next') or a match of at least minMatch chars, without next char.
  ***************************************************************************/
 struct token{
     int off, len;
     char next;
 };
 
+/***************************************************************************
+ * The Huffman codes of the tokens of a block, see writeBlock.
+ ***************************************************************************/
+struct blockCodes{
+    struct huffCode chars;      /* of the next chars (and match lengths) */
+    struct huffCode lens;       /* of the lengths */
+    struct huffCode offs;       /* of the offset buckets */
+};
+
+/***************************************************************************
+ * A position of the optimal parse: the price in bits of the cheapest parse
+ * from where it began, and the last token of that parse, which ends here.
+ ***************************************************************************/
+struct optNode{
+    unsigned int price;
+    int len, off;
+};
+
+/***************************************************************************
+ * The encoder reads its input, and the decoder writes its output, either
+ * from (to) a file or from (to) a memory area.
+ ***************************************************************************/
+struct source{
+    FILE *file;                 /* input file, NULL for a memory input */
+    const unsigned char *mem;   /* memory input */
+    size_t size, pos;           /* its size and the # of bytes read */
+};
+
+struct sink{
+    FILE *file;                 /* output file, NULL for a memory output */
+    unsigned char *mem;         /* memory output */
+    size_t size, pos;           /* its capacity and the # of bytes written */
+    int err;                    /* set when the memory output is too small */
+    struct bitFILE *bits;       /* compressed stream of the encoder, if not NULL */
+};
+
+/***************************************************************************
+ * The match finder of the encoder: the binary search tree of tree.c, the
+ * hash chain of hash.c or the binary tree of bt.c.
+ ***************************************************************************/
+struct finder{
+    int type;                   /* LZ77_TREE, LZ77_HASH or LZ77_BT */
+    unsigned char *window;      /* ring buffer */
+    unsigned int wmask;         /* size of the ring buffer minus one */
+    unsigned int base;          /* position of window[0] */
+    struct searchTree *tree;    /* binary search tree */
+    struct hashChain *hash;     /* hash chain */
+    struct binTree *bt;         /* binary tree */
+    int found;                  /* the lookahead was inserted by the find */
+};
+
+/***************************************************************************
+ * Compression levels, from the fastest to the smallest output. See the
+ * encoder below for the meaning of 'insert' and 'lazy'.
+ ***************************************************************************/
+struct level{
+    int depth;                  /* max hash chain (binary tree) depth */
+    int insert;                 /* positions of a match inserted, 0 for all */
+    int lazy;                   /* token ends tried before the greedy one */
+};
+
+static const struct level levels[MAX_LEVEL + 1] = {
+    {0, 0, 0},                  /* unused */
+    {4, 1, 0},
+    {8, 4, 0},
+    {16, 16, 0},
+    {24, 0, 0},
+    {DEFAULT_DEPTH, 0, 0},      /* default, greedy */
+    {DEFAULT_DEPTH, 0, 1},
+    {48, 0, 2},
+    {64, 0, LAZY_OPTIMAL},
+    {128, 0, LAZY_OPTIMAL}
+};
+
 /***************************************************************************
  *                         FUNCTIONS DECLARATION
  ***************************************************************************/
-void writecode(struct token t, struct bitFILE *out, int la_size, int sb_size);
-struct token readcode(struct bitFILE *file, int la_size, int sb_size);
+struct token match(struct searchTree *tree, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int la, int la_size);
+
+static int encodeSource(struct lz77_encoder *e, struct source *src, struct sink *out);
+static int decodeSink(struct bitFILE *file, struct sink *out, const unsigned char *dict, size_t dictLen);
+static size_t blockBound(const struct lz77_encoder *e);
+static unsigned int encoderKeep(const struct lz77_encoder *e);
+static void probeBlock(struct lz77_encoder *e, unsigned int from, unsigned int to, unsigned int *freq);
+static void blockPrices(struct lz77_encoder *e, const struct blockCodes *c, int coded);
+static void encoderNormalize(struct lz77_encoder *e);
+
+/***************************************************************************
+ *                          BIT LENGTH FUNCTION
+ * Name         : bitLength - # of bits of a value, up to its leading one
+ * Parameters   : n - the value
+ * Returned     : # of bits, 0 for 0
+ ***************************************************************************/
+static inline int bitLength(unsigned int n)
+{
+    return n ? 32 - __builtin_clz(n) : 0;
+}
+
+/***************************************************************************
+ *                           MIN MATCH FUNCTION
+ * Name         : minMatch - shortest match of the LZ77_FLAGGED format: the
+ *                shortest one smaller than its chars sent as literals
+ * Parameters   : offBits - bits of the offset field
+ *                lenBits - bits of the length field
+ * Returned     : # of chars
+ ***************************************************************************/
+static inline int minMatch(int offBits, int lenBits)
+{
+    return (1 + offBits + lenBits) / 9 + 1;
+}
+
+/***************************************************************************
+ *                          TOKEN CODEC FUNCTION
+ * Name         : tokenCodec - choose, once per stream, how the tokens of
+ *                fixed fields are packed and unpacked. A token is the offset,
+ *                the length and the next char from the LSB on, written at
+ *                once (see putFixed and fixedToken):
+ *
+ *                DEFAULT (LA_SIZE = 15, SB_SIZE = 4095), 24 bits:
+ *                  0             11 12   15 16          23
+ *                 +-----------------+-------+-------------+
+ *                 |     offset      |length |  next char  |
+ *                 +-----------------+-------+-------------+
+ *
+ *                In the flagged format a literal is a 0 and the char, a
+ *                match a 1, the offset and the length minus minMatch. The
+ *                widths of the common sizes are constants in copies of their
+ *                own, the others are read from the stream's.
+ * Parameters   : offBits - bits of the offset field
+ *                lenBits - bits of the length field
+ * Returned     : a CODEC_* constant
+ ***************************************************************************/
+static int tokenCodec(int offBits, int lenBits)
+{
+    if (offBits == 12 && lenBits == 4)
+        return CODEC_12_4;
+    if (offBits == 16 && lenBits == 8)
+        return CODEC_16_8;
+    
+    return CODEC_GENERIC;
+}
+
+/* the functions which take the field widths as constants are copied in
+   each of their callers, once per codec */
+#define SPECIALIZED static inline __attribute__((always_inline))
+
+/***************************************************************************
+ *                          READ SOURCE FUNCTION
+ * Name         : readSource - read at most 'n' bytes of the input, as fread
+ * Parameters   : src - input of the encoder
+ *                buf - destination of the bytes
+ *                n - # of bytes wanted
+ * Returned     : # of bytes read
+ ***************************************************************************/
+static int readSource(struct source *src, unsigned char *buf, int n)
+{
+    if (src->file != NULL)
+        return fread(buf, 1, n, src->file);
+    
+    if ((size_t)n > src->size - src->pos)
+        n = src->size - src->pos;
+    memcpy(buf, src->mem + src->pos, n);
+    src->pos += n;
+    
+    return n;
+}
+
+static int sourceEof(struct source *src)
+{
+    return (src->file != NULL) ? feof(src->file) : (src->pos == src->size);
+}
+
+static int sourceError(struct source *src)
+{
+    return (src->file != NULL) ? ferror(src->file) : 0;
+}
+
+/***************************************************************************
+ *                          WRITE SINK FUNCTION
+ * Name         : writeSink - write a block of the decoded output in the
+ *                output file, or copy it in the memory output when the
+ *                decoder doesn't write in place (see decodeSink)
+ * Parameters   : out - output of the decoder
+ *                buf - the block
+ *                n - size of the block
+ * Returned     : 0 on success, -1 on writing errors or if the memory
+ *                output is too small
+ ***************************************************************************/
+static int writeSink(struct sink *out, const unsigned char *buf, size_t n)
+{
+    if (out->file == NULL){
+        if (n > out->size - out->pos){
+            out->err = 1;
+            return -1;
+        }
+        memcpy(&(out->mem[out->pos]), buf, n);
+        out->pos += n;
+        return 0;
+    }
+    if (fwrite(buf, 1, n, out->file) != n)
+        return -1;
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                            COPY 16 FUNCTION
+ * Name         : copy16 - copy 16 bytes with a single unaligned load and
+ *                store, when SSE2 is there
+ * Parameters   : dst - destination
+ *                src - source
+ ***************************************************************************/
+static inline void copy16(unsigned char *dst, const unsigned char *src)
+{
+#ifdef __SSE2__
+    _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+#else
+    memcpy(dst, src, 16);
+#endif
+}
 
-struct token match(struct node *tree, int root, unsigned char *window, int la, int la_size);
+/***************************************************************************
+ *                         MEMMOVE MATCH FUNCTION
+ * Name         : memmoveMatch - reconstruct a match byte per byte, without
+ *                writing past it (the end of a memory output)
+ * Parameters   : dst - where the match goes
+ *                off - offset of the match
+ *                len - length of the match
+ ***************************************************************************/
+static void memmoveMatch(unsigned char *dst, int off, int len)
+{
+    int i;
+    
+    for (i = 0; i < len; i++)
+        dst[i] = dst[i - off];
+}
 
 /***************************************************************************
  *                            ENCODE FUNCTION
@@ -50,234 +335,3108 @@ struct token match(struct node *tree, int root, unsigned char *window, int la, i
  ***************************************************************************/
 void encode(FILE *file, struct bitFILE *out, int la, int sb)
 {
-    /* variables */
-    int i, root = -1;
-    int eof;
-    struct node *tree;
-    struct token t;
-    unsigned char *window;
-    int la_size, sb_size = 0;    /* actual lookahead and search buffer size */
-    int buff_size;
-    int sb_index = 0, la_index = 0;
-    int LA_SIZE, SB_SIZE, WINDOW_SIZE;
-    
-    /* set window parameters */
-    LA_SIZE = (la == -1) ? DEFAULT_LA_SIZE : la;
-    SB_SIZE = (sb == -1) ? DEFAULT_SB_SIZE : sb;
-    WINDOW_SIZE = (SB_SIZE * N) + LA_SIZE;
+    struct lz77_params p;
     
-    window = calloc(WINDOW_SIZE, sizeof(unsigned char));
+    lz77_defaults(&p);
+    p.la = la;
+    p.sb = sb;
     
-    tree = createTree(SB_SIZE);
+    lz77_encode(file, out, &p);
+}
+
+/***************************************************************************
+ *                          LZ77 ENCODE FUNCTION
+ * Name         : lz77_encode - compress file with the given parameters
+ * Parameters   : file - file to encode
+ *                out - compressed file
+ *                p - encoder parameters
+ * Returned     : 0 on success, -1 on reading errors
+ ***************************************************************************/
+int lz77_encode(FILE *file, struct bitFILE *out, const struct lz77_params *p)
+{
+    struct source src = {file, NULL, 0, 0};
+    struct sink dst = {NULL, NULL, 0, 0, 0, out};
+    struct lz77_encoder *e;
+    int ret;
     
-    /* write header */
-    bitIO_write(out, &SB_SIZE, MAX_BIT_BUFFER);
-    bitIO_write(out, &LA_SIZE, MAX_BIT_BUFFER);
+    if ((e = lz77_encoder_create(p)) == NULL)
+        return -1;
+    ret = encodeSource(e, &src, &dst);
+    lz77_encoder_destroy(e);
     
-    /* fill the lookahead with the first LA_SIZE bytes or until EOF is reached */
-    buff_size = fread(window, 1, WINDOW_SIZE, file);
-    if(ferror(file)) {
-        printf("Error loading the data in the window.\n");
-        return;
-   	}
+    return ret;
+}
+
+/***************************************************************************
+ *                          LZ77 DEFAULTS FUNCTION
+ * Name         : lz77_defaults - set the default encoder parameters
+ * Parameters   : p - encoder parameters
+ ***************************************************************************/
+void lz77_defaults(struct lz77_params *p)
+{
+    p->la = -1;
+    p->sb = -1;
+    p->finder = LZ77_BT;
+    p->depth = -1;
+    p->level = -1;
+    p->huffman = 0;
+    p->format = LZ77_TRIPLES;
+    p->dict = NULL;
+    p->dictLen = 0;
+    p->checksum = 0;
+    p->alloc = NULL;
+}
+
+/***************************************************************************
+ *                          LZ77 COMPRESS FUNCTION
+ * Name         : lz77_compress - compress a memory area into another one
+ * Parameters   : src - data to compress
+ *                srcLen - size of the data
+ *                dst - destination of the compressed stream
+ *                dstCap - size of the destination, see lz77_compress_bound
+ *                la - lookahead size (-1 for default)
+ *                sb - search buffer size (-1 for default)
+ * Returned     : size of the compressed stream, LZ77_ERROR if it didn't fit
+ ***************************************************************************/
+size_t lz77_compress(const void *src, size_t srcLen, void *dst, size_t dstCap, int la, int sb)
+{
+    struct lz77_params p;
     
-    eof = feof(file);
+    lz77_defaults(&p);
+    p.la = la;
+    p.sb = sb;
     
-    /* set lookahead's size */
-    la_size = (buff_size > LA_SIZE) ? LA_SIZE : buff_size;
+    return lz77_compress_params(src, srcLen, dst, dstCap, &p);
+}
+
+/***************************************************************************
+ *                      LZ77 COMPRESS PARAMS FUNCTION
+ * Name         : lz77_compress_params - compress a memory area into another
+ *                one with the given parameters
+ * Parameters   : src - data to compress
+ *                srcLen - size of the data
+ *                dst - destination of the compressed stream
+ *                dstCap - size of the destination, see lz77_compress_bound
+ *                p - encoder parameters
+ * Returned     : size of the compressed stream, LZ77_ERROR if it didn't fit
+ ***************************************************************************/
+size_t lz77_compress_params(const void *src, size_t srcLen, void *dst, size_t dstCap, const struct lz77_params *p)
+{
+    struct lz77_encoder *e;
+    size_t size;
     
-	while(buff_size > 0){
-		
-        /* find the longest match of the lookahead in the tree*/
-        t = match(tree, root, window, la_index, la_size);
-        
-        /* write the token in the output file */
-        writecode(t, out, LA_SIZE, SB_SIZE);
-        
-        /* read as many bytes as matched in the previuos iteration */
-        for(i = 0; i < t.len + 1; i++){
-            
-            /* if search buffer's length is max, the oldest node is removed from the tree */
-            if(sb_size == SB_SIZE){
-                delete(tree, &root, window, sb_index, SB_SIZE);
-                sb_index++;
-            }else
-                sb_size++;
-            
-            /* insert a new node in the tree */
-            insert(tree, &root, window, la_index, la_size, SB_SIZE);
-            la_index++;
-            
-            if (eof == 0){
-                /* scroll backward the buffer when it is almost full */
-                if (sb_index == SB_SIZE * (N - 1)){
-                    memmove(window, &(window[sb_index]), sb_size+la_size);
-                    
-                    /* update the node's offset when the buffer is scrolled */
-                    updateOffset(tree, sb_index, SB_SIZE);
-                    
-                    sb_index = 0;
-                    la_index = sb_size;
-                    
-                    /* read from file */
-                    buff_size += fread(&(window[sb_size+la_size]), 1, WINDOW_SIZE-(sb_size+la_size), file);
-                    if(ferror(file)) {
-                        printf("Error loading the data in the window.\n");
-                        return;
-                    }
-                    eof = feof(file);
-                }
-            }
-            
-            buff_size--;
-            /* case where we hit EOF before filling lookahead */
-            la_size = (buff_size > LA_SIZE) ? LA_SIZE : buff_size;
-        }
-	}
+    if ((e = lz77_encoder_create(p)) == NULL)
+        return LZ77_ERROR;
+    size = lz77_compress_ctx(e, src, srcLen, dst, dstCap);
+    lz77_encoder_destroy(e);
     
-    destroyTree(tree);
-    free(window);
+    return size;
 }
 
 /***************************************************************************
- *                            DECODE FUNCTION
- * Name         : decode - decompress file
- * Parameters   : file - compressed file
- *                out - output file
+ *                       LZ77 COMPRESS BOUND FUNCTION
+ * Name         : lz77_compress_bound - worst case size of the compressed
+ *                stream: the header (with a dictionary ID) plus the input
+ *                and the headers of the blocks, when the last segment of a
+ *                block can always be stored (see writeBlock); otherwise a
+ *                token without match per byte
+ * Parameters   : srcLen - size of the data to compress
+ *                la - lookahead size (-1 for default)
+ *                sb - search buffer size (-1 for default)
+ * Returned     : maximum size of the compressed stream
  ***************************************************************************/
-void decode(struct bitFILE *file, FILE *out)
+size_t lz77_compress_bound(size_t srcLen, int la, int sb)
 {
-    /* variables */
-    struct token t;
-    int back = 0, off;
-    unsigned char *buffer;
-    int SB_SIZE, LA_SIZE, WINDOW_SIZE;
+    int LA_SIZE = (la == -1) ? DEFAULT_LA_SIZE : la;
+    int SB_SIZE = (sb == -1) ? DEFAULT_SB_SIZE : sb;
+    size_t bits = bitof(SB_SIZE) + bitof(LA_SIZE) + 8;
+    /* a block ends at HUFF_BLOCK tokens (of at least a byte each) and may
+       be split there, and up to three end at each segment: the two halves
+       of the block before it and the segment stored; the stream ends with
+       an empty block. Each one may have a checksum after it */
+    size_t blocks = 6 * (srcLen / STORED_BLOCK) + 8;
+    size_t header = (2 * MAX_BIT_BUFFER + DICT_ID_BITS) / 8;
+    size_t fixed, stored;
     
-    /* read header */
-    bitIO_read(file, &SB_SIZE, sizeof(SB_SIZE), MAX_BIT_BUFFER);
-    bitIO_read(file, &LA_SIZE, sizeof(LA_SIZE), MAX_BIT_BUFFER);
+    if (LA_SIZE > HEADER_MAX_LA || SB_SIZE > HEADER_MAX_SB)
+        header += (WIDE_SB_BITS + WIDE_LA_BITS) / 8;
+    
+    /* no block is larger than its fixed tokens, nor, when a segment and a
+       lookahead fit in a stored block, than its bytes and the header and
+       the padding of a stored block */
+    fixed = header + (srcLen * bits + 7) / 8 + (blocks * (BLOCK_COUNT_BITS + 1 + SUM_BITS) + 7) / 8;
+    if (STORED_BLOCK - 1 + LA_SIZE > STORED_MAX)
+        return fixed;
+    stored = header + srcLen + (blocks * (BLOCK_COUNT_BITS + 1 + STORED_LEN_BITS + 7 + SUM_BITS) + 7) / 8;
     
-    WINDOW_SIZE = (SB_SIZE * N) + LA_SIZE;
+    return (stored < fixed) ? stored : fixed;
+}
+
+/***************************************************************************
+ *                         LZ77 DICT ID FUNCTION
+ * Name         : lz77_dict_id - ID of a preset dictionary, stored in the
+ *                header of the streams encoded with it: the decoder checks
+ *                it was given the same one. It is the 32 bits FNV-1a hash
+ *                of the whole dictionary.
+ * Parameters   : dict - the dictionary
+ *                len - its size
+ * Returned     : the ID
+ ***************************************************************************/
+unsigned int lz77_dict_id(const void *dict, size_t len)
+{
+    const unsigned char *p = dict;
+    uint32_t h = 2166136261U;
+    size_t i;
     
-    buffer = (unsigned char*)calloc(WINDOW_SIZE, sizeof(unsigned char));
+    for (i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619U;
     
-    while(1)
-    {
-        /* read the code from the input file */
-        t = readcode(file, LA_SIZE, SB_SIZE);
+    return h;
+}
 
-        if(t.off == -1)
-            break;
-        
-        if(back + t.len > WINDOW_SIZE - 1){
-            memcpy(buffer, &(buffer[back - SB_SIZE]), SB_SIZE);
-            back = SB_SIZE;
-        }
-        
-        /* reconstruct the original byte*/
-        while(t.len > 0)
-        {
-            off = back - t.off;
-            buffer[back] = buffer[off];
-            
-            /* write the byte in the output file*/
-            putc(buffer[back], out);
-            
-            back++;
-            t.len--;
-        }
-        buffer[back] = t.next;
-        
-        /* write the byte in the output file*/
-        putc(buffer[back], out);
-        
-        back++;
-    }
+/***************************************************************************
+ *                         CREATE FINDER FUNCTION
+ * Name         : createFinder - set up the match finder chosen by the user
+ * Parameters   : f - match finder
+ *                p - encoder parameters
+ *                depth - max hash chain (binary tree) depth
+ *                sb_size - search buffer size
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                a - allocator, NULL for malloc
+ * Returned     : 0 on success, -1 if there is no memory
+ ***************************************************************************/
+static int createFinder(struct finder *f, const struct lz77_params *p, int depth, int sb_size, unsigned char *window, unsigned int wmask,
+                        const struct lz77_alloc *a)
+{
+    f->type = p->finder;
+    f->window = window;
+    f->wmask = wmask;
+    f->base = 0;
+    f->tree = NULL;
+    f->hash = NULL;
+    f->bt = NULL;
+    f->found = 0;
     
+    if (f->type == LZ77_HASH)
+        f->hash = createHash(sb_size, depth, a);
+    else if (f->type == LZ77_BT)
+        f->bt = createBinTree(sb_size, depth, a);
+    else
+        f->tree = createTree(sb_size, a);
+    
+    return (f->hash == NULL && f->bt == NULL && f->tree == NULL) ? -1 : 0;
+}
+
+static void destroyFinder(struct finder *f)
+{
+    if (f->hash != NULL)
+        destroyHash(f->hash);
+    if (f->bt != NULL)
+        destroyBinTree(f->bt);
+    if (f->tree != NULL)
+        destroyTree(f->tree);
 }
 
 /***************************************************************************
- *                            MATCH FUNCTION
- * Name         : match - find the longest match and create the token
- * Parameters   : tree - binary search tree
- *                root - index of the root
- *                window - pointer to the buffer
- *                la - starting index of the lookahead
+ *                          FINDER MATCH FUNCTION
+ * Name         : finderMatch - find the longest match and create the token
+ * Parameters   : f - match finder
+ *                la - absolute position of the lookahead
  *                la_size - actual lookahead size
+ *                all - where the shorter and nearer matches met on the way
+ *                      go too, NULL if they are not wanted (the tree
+ *                      finder only gives the longest one)
  * Returned     : token of the best match
  ***************************************************************************/
-struct token match(struct node *tree, int root, unsigned char *window, int la, int la_size)
+static struct token finderMatch(struct finder *f, unsigned int la, int la_size, struct matches *all)
 {
-    /* variables */
     struct token t;
     struct ret r;
     
-    /* find the longest match */
-    r = find(tree, root, window, la, la_size);
+    if (f->type == LZ77_TREE){
+        t = match(f->tree, f->window, f->wmask, f->base, la, la_size);
+        if (all != NULL){
+            all->n = 0;
+            if (t.len > 0)
+                addMatch(all, t.off, t.len);
+        }
+        return t;
+    }
     
-    /* create the token */
+    if (f->type == LZ77_BT){
+        /* the binary tree inserts the lookahead while looking for it */
+        r = binTreeFind(f->bt, f->window, f->wmask, f->base, la, la_size, all);
+        f->found = 1;
+    }else
+        r = hashFind(f->hash, f->window, f->wmask, f->base, la, la_size, all);
     t.off = r.off;
     t.len = r.len;
-    t.next = window[la+r.len];
+    t.next = f->window[(la + r.len - f->base) & f->wmask];
     
     return t;
 }
 
 /***************************************************************************
- *                           WRITECODE FUNCTION
- * Name         : writecode - write the token in the output file
- * Parameters   : t - token to be written
- *                out - output file
- * SB_SIZE = n  =>  ceil(log(n)/log(2)) bits for Offset representation
- * LA_SIZE = m  =>  ceil(log(m)/log(2)) bits for Length representation
- * Alway 8 bits for Next char representation
- *
- * DEFAULT (LA_SIZE = 15, SB_SIZE = 4095):
- * Offset : 12 bits representation => [0, 4095]
- * Length : 4 bits representation => [0, 15]
- * Next char requires 8 bits
- * Total token's size: 12 + 4 + 8 = 24 bits = 3 bytes
- *
- *     0 1 2 3 4 5 6 7 0 1 2 3 4 5 6 7 0 1 2 3 4 5 6 7
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- *    |         offset        |lenght |   next char   |
- *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *                          FINDER SLIDE FUNCTION
+ * Name         : finderSlide - move a position from the lookahead to the
+ *                search buffer, dropping the oldest one if it is full
+ * Parameters   : f - match finder
+ *                full - the search buffer is full
+ *                la - absolute position of the new position
+ *                la_size - actual lookahead size
+ *                sb_size - search buffer size
+ ***************************************************************************/
+static void finderSlide(struct finder *f, int full, unsigned int la, int la_size, int sb_size)
+{
+    STATS_ADD(slides, 1);
+    
+    /* the hash chain and the binary tree just forget the positions too far away */
+    if (f->type == LZ77_HASH){
+        hashInsert(f->hash, f->window, f->wmask, f->base, la, la_size);
+        return;
+    }
+    if (f->type == LZ77_BT){
+        if (f->found)
+            f->found = 0;
+        else
+            binTreeInsert(f->bt, f->window, f->wmask, f->base, la, la_size);
+        return;
+    }
+    
+    if (full)
+        delete(f->tree, la - sb_size);
+    insert(f->tree, f->window, f->wmask, f->base, la, la_size);
+}
+
+/***************************************************************************
+ *                        FINDER NORMALIZE FUNCTION
+ * Name         : finderNormalize - bring the positions back before they
+ *                overflow
+ * Parameters   : f - match finder
+ *                n - value to subtract, a multiple of the ring buffer size
+ ***************************************************************************/
+static void finderNormalize(struct finder *f, unsigned int n)
+{
+    if (f->type == LZ77_HASH)
+        hashNormalize(f->hash, n);
+    else if (f->type == LZ77_BT)
+        binTreeNormalize(f->bt, n);
+    /* the binary search tree keeps no positions: n maps on the same slots */
+}
+
+/***************************************************************************
+ *                          FINDER RESET FUNCTION
+ * Name         : finderReset - forget the positions of the previous stream:
+ *                the hash chain and the binary tree drop them by themselves
+ *                once out of the search buffer (see lz77_encoder_reset), the
+ *                binary search tree is emptied
+ * Parameters   : f - match finder
+ ***************************************************************************/
+static void finderReset(struct finder *f)
+{
+    f->found = 0;
+    if (f->tree != NULL)
+        resetTree(f->tree);
+}
+
+/***************************************************************************
+ *                          FILL WINDOW FUNCTION
+ * Name         : fillWindow - read as much input as fits in the ring buffer
+ *                without overwriting the search buffer. The first 'la_max'
+ *                bytes of the ring are copied after its end, so that any
+ *                sequence up to the lookahead size is contiguous in memory.
+ * Parameters   : src - input of the encoder
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                la_max - lookahead size
+ *                from - absolute position of the oldest byte to keep
+ *                end - absolute position of the end of the data read
+ *                eof - set when the input is over
+ * Returned     : 0 on success, -1 on reading errors
  ***************************************************************************/
-void writecode(struct token t, struct bitFILE *out, int la_size, int sb_size)
+static int fillWindow(struct source *src, unsigned char *window, unsigned int wmask, int la_max, unsigned int from, unsigned int *end, int *eof)
 {
+    unsigned int room = wmask + 1 - (*end - from);
+    unsigned int idx, n, r;
+    
+    while (room > 0 && *eof == 0){
+        /* up to the end of the ring, then from its start */
+        idx = *end & wmask;
+        n = (room < wmask + 1 - idx) ? room : (wmask + 1 - idx);
+        
+        r = readSource(src, &(window[idx]), n);
+        STATS_ADD(refills, 1);
+        if (sourceError(src))
+            return -1;
+        
+        if (idx < (unsigned int)la_max)
+            memcpy(&(window[wmask + 1 + idx]), &(window[idx]), ((idx + r < (unsigned int)la_max) ? (idx + r) : (unsigned int)la_max) - idx);
+        
+        *end += r;
+        room -= r;
+        if (r < n || sourceEof(src))
+            *eof = 1;
+    }
+    
+    return 0;
+}
 
-    bitIO_write(out, &t.off, bitof(sb_size));
-    bitIO_write(out, &t.len, bitof(la_size));
-    bitIO_write(out, &t.next, 8);
+/***************************************************************************
+ *                            DECODE FUNCTION
+ * Name         : decode - decompress file
+ * Parameters   : file - compressed file
+ *                out - output file
+ * Returned     : 0 on success, -1 if the stream is corrupted
+ ***************************************************************************/
+int decode(struct bitFILE *file, FILE *out)
+{
+    return lz77_decode(file, out, NULL, 0);
 }
 
 /***************************************************************************
- *                          READCODE FUNCTION
- * Name         : readcode - read the token from the compressed file
+ *                          LZ77 DECODE FUNCTION
+ * Name         : lz77_decode - decompress file encoded with a preset
+ *                dictionary, or without any
  * Parameters   : file - compressed file
- * Returned     : t - reconstructed token
- ***************************************************************************/
-struct token readcode(struct bitFILE *file, int la_size, int sb_size)
-{
-	/* variables */
-	struct token t;
-	int ret = 0;
-
-	ret += bitIO_read(file, &t.off, sizeof(t.off), bitof(sb_size));
-	ret += bitIO_read(file, &t.len, sizeof(t.len), bitof(la_size));
-	ret += bitIO_read(file, &t.next, sizeof(t.next), 8);
-		
-	/* check for EOF or ERR */	
-	if(ret < (bitof(sb_size) + bitof(la_size) + 8)){
-		/* ERR */		
-		if(bitIO_ferror(file) != 0)
-		{
-			perror("Error reading bits.\n");
-			exit(EXIT_FAILURE);
-		}
-		/* EOF */
-		t.off = -1;
-	}
-
-	return t;
+ *                out - output file
+ *                dict - the dictionary of the encoder (NULL for none)
+ *                dictLen - its size
+ * Returned     : 0 on success, -1 if the stream is corrupted or needs
+ *                another dictionary
+ ***************************************************************************/
+int lz77_decode(struct bitFILE *file, FILE *out, const void *dict, size_t dictLen)
+{
+    struct sink dst = {out, NULL, 0, 0, 0, NULL};
+    
+    return decodeSink(file, &dst, dict, dictLen);
+}
+
+/***************************************************************************
+ *                         LZ77 DECOMPRESS FUNCTION
+ * Name         : lz77_decompress - decompress a memory area into another one
+ * Parameters   : src - compressed stream
+ *                srcLen - size of the compressed stream
+ *                dst - destination of the data
+ *                dstCap - size of the destination
+ * Returned     : size of the data, LZ77_ERROR if the stream is corrupted or
+ *                the data didn't fit
+ ***************************************************************************/
+size_t lz77_decompress(const void *src, size_t srcLen, void *dst, size_t dstCap)
+{
+    return lz77_decompress_dict(src, srcLen, dst, dstCap, NULL, 0);
+}
+
+/***************************************************************************
+ *                       LZ77 DECOMPRESS DICT FUNCTION
+ * Name         : lz77_decompress_dict - decompress a memory area encoded
+ *                with a preset dictionary into another one
+ * Parameters   : src - compressed stream
+ *                srcLen - size of the compressed stream
+ *                dst - destination of the data
+ *                dstCap - size of the destination
+ *                dict - the dictionary of the encoder (NULL for none)
+ *                dictLen - its size
+ * Returned     : size of the data, LZ77_ERROR if the stream is corrupted,
+ *                needs another dictionary or the data didn't fit
+ ***************************************************************************/
+size_t lz77_decompress_dict(const void *src, size_t srcLen, void *dst, size_t dstCap, const void *dict, size_t dictLen)
+{
+    struct sink out = {NULL, dst, dstCap, 0, 0, NULL};
+    struct bitFILE *in;
+    int ret;
+    
+    /* the stream is only read, the bitFILE doesn't write in its buffer */
+    if ((in = bitIO_open_mem((void *)src, srcLen, BIT_IO_R)) == NULL)
+        return LZ77_ERROR;
+    
+    ret = decodeSink(in, &out, dict, dictLen);
+    bitIO_close(in);
+    
+    return (ret < 0 || out.err) ? LZ77_ERROR : out.pos;
+}
+
+/***************************************************************************
+ *                          COPY MATCH FUNCTION
+ * Name         : copyMatch - reconstruct a match, 'len' bytes from 'off'
+ *                bytes back. Far matches are copied 16 (8) bytes at a time;
+ *                matches closer than 8 bytes (runs, short periods) repeat
+ *                their first 'off' bytes, broadcast into a 16 bytes pattern
+ *                which is stored as a whole at each step. Up to 15 bytes
+ *                after the match may be overwritten.
+ * Parameters   : dst - where the match goes
+ *                off - offset of the match
+ *                len - length of the match
+ ***************************************************************************/
+static inline void copyMatch(unsigned char *dst, int off, int len)
+{
+    const unsigned char *src = dst - off;
+    unsigned char *end = dst + len;
+    unsigned char pat[16];
+    int i, step;
+    
+    if (off >= 16){
+        do{
+            copy16(dst, src);
+            dst += 16;
+            src += 16;
+        }while (dst < end);
+    }else if (off >= 8){
+        do{
+            memcpy(dst, src, 8);
+            dst += 8;
+            src += 8;
+        }while (dst < end);
+    }else{
+        /* the pattern restarts after the largest multiple of 'off' in 16 */
+        for (i = 0; i < 16; i++)
+            pat[i] = src[i % off];
+        step = 16 - (16 % off);
+        do{
+            copy16(dst, pat);
+            dst += step;
+        }while (dst < end);
+    }
+}
+
+/***************************************************************************
+ *                              TOKEN READER
+ * What the decoders know of the stream: the header's sizes and flags and,
+ * in a stream of blocks, the block being read and its decoding tables.
+ ***************************************************************************/
+struct tokenReader{
+    int la_size, sb_size;       /* lookahead and search buffer size */
+    int flags;                  /* STREAM_* flags of the header */
+    int format;                 /* LZ77_TRIPLES or LZ77_FLAGGED */
+    int offBits, lenBits;       /* bits of the fixed fields */
+    int codec;                  /* how they are unpacked, see tokenCodec */
+    int minMatch;               /* shortest match (LZ77_FLAGGED) */
+    int nchars, nlens;          /* # of chars (and match lengths) and of lengths coded */
+    int offSyms;                /* # of offset buckets */
+    int blocks;                 /* the tokens are in blocks */
+    int left;                   /* tokens (bytes) left in the block */
+    int coded;                  /* the block is Huffman coded */
+    int stored;                 /* the block is stored */
+    struct huffTable chars, lens, offs;
+    int summed;                 /* a block was read, its checksum comes before the next one */
+    int check;                  /* the checksum of the block before was just read */
+    uint32_t blockSum, streamSum;   /* the checksums read */
+    struct checksum sum;        /* of the bytes of the block decoded so far */
+    struct checksum chain;      /* of the checksums of the blocks so far */
+};
+
+/***************************************************************************
+ *                          READER SIZES FUNCTION
+ * Name         : readerSizes - set up what depends on the sizes
+ * Parameters   : rd - token reader
+ * Returned     : 0 on success, -1 if the sizes are not valid
+ ***************************************************************************/
+static int readerSizes(struct tokenReader *rd)
+{
+    /* the widths of the fields are only computed on valid sizes */
+    if (rd->la_size == 0 || rd->sb_size == 0)
+        return -1;
+    
+    rd->offBits = bitof(rd->sb_size);
+    rd->lenBits = bitof(rd->la_size);
+    rd->codec = tokenCodec(rd->offBits, rd->lenBits);
+    rd->minMatch = minMatch(rd->offBits, rd->lenBits);
+    rd->offSyms = bitLength(rd->sb_size);
+    
+    /* the flagged format codes the match lengths with the chars */
+    if (rd->format == LZ77_FLAGGED){
+        rd->nchars = 256 + ((rd->la_size > rd->minMatch) ? rd->la_size - rd->minMatch : 0);
+        rd->nlens = 0;
+    }else{
+        rd->nchars = 256;
+        rd->nlens = rd->la_size;
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *                          READER INIT FUNCTION
+ * Name         : readerInit - set up the reader from the stream header: 16
+ *                bits of search buffer size, 8 of lookahead size and 8 of
+ *                flags, whose bits 4-6 are the token format (0 in a plain
+ *                stream of triples, as in the older 16 bits lookahead size,
+ *                which was at most 255). With STREAM_WIDE the sizes are in
+ *                the next 48 bits instead, see readerWide. With STREAM_DICT
+ *                the 32 bits ID of the dictionary follows the sizes. The
+ *                tokens are in blocks with STREAM_HUFFMAN or STREAM_STORED,
+ *                and only the latter may have stored blocks. A stream of
+ *                STREAM_STORED may also have STREAM_CHECKSUM, see
+ *                readerCheck.
+ * Parameters   : rd - token reader
+ *                header - the 32 bits of the header
+ * Returned     : 0 on success, 1 if the wide sizes follow, -1 if the header
+ *                is not valid
+ ***************************************************************************/
+static int readerInit(struct tokenReader *rd, uint64_t header)
+{
+    rd->sb_size = header & 0xFFFF;
+    rd->la_size = (header >> MAX_BIT_BUFFER) & 0xFF;
+    rd->flags = (header >> (MAX_BIT_BUFFER + 8)) & 0xFF & ~(STREAM_FORMAT_MASK << STREAM_FORMAT_SHIFT);
+    rd->format = (header >> (MAX_BIT_BUFFER + 8 + STREAM_FORMAT_SHIFT)) & STREAM_FORMAT_MASK;
+    rd->blocks = (rd->flags & (STREAM_HUFFMAN | STREAM_STORED)) != 0;
+    rd->left = 0;
+    rd->coded = 0;
+    rd->stored = 0;
+    rd->summed = 0;
+    rd->check = 0;
+    checksumInit(&rd->sum);
+    checksumInit(&rd->chain);
+    
+    if ((rd->flags & ~(STREAM_HUFFMAN | STREAM_WIDE | STREAM_DICT | STREAM_STORED | STREAM_CHECKSUM)) != 0
+        || rd->format > LZ77_FLAGGED || ((rd->flags & STREAM_CHECKSUM) && !(rd->flags & STREAM_STORED)))
+        return -1;
+    /* the Huffman tokens must fit in a refill of the bit buffer */
+    if (rd->flags & STREAM_WIDE)
+        return (rd->flags & STREAM_HUFFMAN) ? -1 : 1;
+    return readerSizes(rd);
+}
+
+/***************************************************************************
+ *                          READER WIDE FUNCTION
+ * Name         : readerWide - set the sizes of a wide header
+ * Parameters   : rd - token reader
+ *                sb_size - search buffer size, 32 bits
+ *                la_size - lookahead size, 16 bits
+ * Returned     : 0 on success, -1 if the sizes are not valid
+ ***************************************************************************/
+static int readerWide(struct tokenReader *rd, uint64_t sb_size, uint64_t la_size)
+{
+    if (sb_size > LZ77_MAX_SB)
+        return -1;
+    rd->sb_size = sb_size;
+    rd->la_size = la_size;
+    
+    return readerSizes(rd);
+}
+
+/***************************************************************************
+ *                         READER TABLES FUNCTION
+ * Name         : readerTables - build the decoding tables of a block
+ * Parameters   : rd - token reader
+ *                len - lengths of the codes of the chars, of the lengths (in
+ *                      the triples format) and of the offset buckets
+ * Returned     : 0 on success, -1 if they aren't valid codes
+ ***************************************************************************/
+static int readerTables(struct tokenReader *rd, const unsigned char *len)
+{
+    if (huffTable(&rd->chars, len, rd->nchars) < 0)
+        return -1;
+    if (rd->nlens > 0 && huffTable(&rd->lens, &(len[rd->nchars]), rd->nlens) < 0)
+        return -1;
+    if (huffTable(&rd->offs, &(len[rd->nchars + rd->nlens]), rd->offSyms) < 0)
+        return -1;
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                           CHAIN SUM FUNCTION
+ * Name         : chainSum - add the checksum of a block to the one of the
+ *                stream, which is the CRC-32C of the checksums of its
+ *                blocks as 4 bytes little endian: the stream is checked
+ *                without hashing its bytes twice.
+ * Parameters   : chain - checksum of the stream
+ *                sum - checksum of the block
+ ***************************************************************************/
+static void chainSum(struct checksum *chain, uint32_t sum)
+{
+    unsigned char b[SUM_BITS / 8] = {sum, sum >> 8, sum >> 16, sum >> 24};
+    
+    checksumUpdate(chain, b, sizeof(b));
+}
+
+/***************************************************************************
+ *                          READER HASH FUNCTION
+ * Name         : readerHash - add decoded bytes to the checksum of their
+ *                block, as they are output
+ * Parameters   : rd - token reader
+ *                p - the bytes
+ *                n - their #
+ ***************************************************************************/
+static inline void readerHash(struct tokenReader *rd, const unsigned char *p, size_t n)
+{
+    if (rd->flags & STREAM_CHECKSUM)
+        checksumUpdate(&rd->sum, p, n);
+}
+
+/***************************************************************************
+ *                          READER CHECK FUNCTION
+ * Name         : readerCheck - check a block with STREAM_CHECKSUM: each
+ *                block, stored or not, is followed by the CRC-32C of its
+ *                bytes, and the empty block which ends the stream by the
+ *                checksum of the stream (see chainSum), so that a block
+ *                missing at the end is found.
+ * Parameters   : rd - token reader, with all the bytes of the block hashed
+ *                sum - the checksum read
+ * Returned     : 0 if they match, -1 otherwise
+ ***************************************************************************/
+static int readerCheck(struct tokenReader *rd, uint32_t sum)
+{
+    rd->check = 0;
+    if (checksumDigest(&rd->sum) != sum)
+        return -1;
+    chainSum(&rd->chain, sum);
+    checksumInit(&rd->sum);
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                          FIXED TOKEN FUNCTION
+ * Name         : fixedToken - decode a token of fixed fields (see
+ *                tokenCodec), with the widths of the reader's codec
+ * Parameters   : rd - token reader
+ *                bits - next bits of the stream
+ *                t - where the token goes
+ *                offBits - bits of the offset field
+ *                lenBits - bits of the length field
+ * Returned     : # of bits of the token
+ ***************************************************************************/
+SPECIALIZED int fixedFields(const struct tokenReader *rd, uint64_t bits, struct token *t, const int offBits, const int lenBits)
+{
+    if (rd->format == LZ77_FLAGGED){
+        /* flag 0: a literal, flag 1: a match */
+        if ((bits & 1) == 0){
+            t->off = 0;
+            t->len = 0;
+            t->next = (char)(bits >> 1);
+            return 9;
+        }
+        t->off = (bits >> 1) & ((1ULL << offBits) - 1);
+        t->len = ((bits >> (1 + offBits)) & ((1ULL << lenBits) - 1)) + minMatch(offBits, lenBits);
+        t->next = 0;
+        return 1 + offBits + lenBits;
+    }
+    
+    t->off = bits & ((1ULL << offBits) - 1);
+    t->len = (bits >> offBits) & ((1ULL << lenBits) - 1);
+    t->next = (char)(bits >> (offBits + lenBits));
+    
+    return offBits + lenBits + 8;
+}
+
+static inline int fixedToken(const struct tokenReader *rd, uint64_t bits, struct token *t)
+{
+    switch (rd->codec){
+        case CODEC_12_4:
+            return fixedFields(rd, bits, t, 12, 4);
+        case CODEC_16_8:
+            return fixedFields(rd, bits, t, 16, 8);
+        default:
+            return fixedFields(rd, bits, t, rd->offBits, rd->lenBits);
+    }
+}
+
+/***************************************************************************
+ *                           HUFF TOKEN FUNCTION
+ * Name         : huffToken - decode a Huffman coded token (see writeBlock)
+ *                with a table lookup per field
+ * Parameters   : rd - token reader
+ *                bits - next bits of the stream, at least the longest token
+ *                t - where the token goes
+ * Returned     : # of bits of the token, -1 if the bits are no token
+ ***************************************************************************/
+static inline int huffToken(const struct tokenReader *rd, uint64_t bits, struct token *t)
+{
+    int n, used, sym;
+    
+    if (rd->format == LZ77_FLAGGED){
+        /* a char, or the length of a match and then its offset */
+        if ((used = huffDecode(&rd->chars, bits, &sym)) == 0)
+            return -1;
+        t->off = 0;
+        t->len = 0;
+        t->next = (char)sym;
+        if (sym < 256)
+            return used;
+        bits >>= used;
+        t->len = sym - 256 + rd->minMatch;
+        if ((n = huffDecode(&rd->offs, bits, &sym)) == 0)
+            return -1;
+        bits >>= n;
+        t->off = (1U << sym) | (bits & ((1U << sym) - 1));
+        return used + n + sym;
+    }
+    
+    if ((used = huffDecode(&rd->lens, bits, &t->len)) == 0)
+        return -1;
+    bits >>= used;
+    
+    t->off = 0;
+    if (t->len > 0){
+        if ((n = huffDecode(&rd->offs, bits, &sym)) == 0)
+            return -1;
+        bits >>= n;
+        t->off = (1U << sym) | (bits & ((1U << sym) - 1));
+        bits >>= sym;
+        used += n + sym;
+    }
+    
+    if ((n = huffDecode(&rd->chars, bits, &sym)) == 0)
+        return -1;
+    t->next = (char)sym;
+    
+    return used + n;
+}
+
+/***************************************************************************
+ *                           READ BLOCK FUNCTION
+ * Name         : readBlock - read the header and the tables of a block, or
+ *                the header of a stored block up to its bytes. With
+ *                STREAM_CHECKSUM, the checksum of the block before comes
+ *                first, and rd->check is set for the caller to compare it
+ *                once it has hashed the bytes of that block; the one of the
+ *                stream follows the end of the stream.
+ * Parameters   : file - compressed stream
+ *                rd - token reader
+ * Returned     : 1 on success, 0 at the end of the stream, -1 if the
+ *                stream is corrupted
+ ***************************************************************************/
+static int readBlock(struct bitFILE *file, struct tokenReader *rd)
+{
+    unsigned char len[256 + HUFF_MAX_SYMBOLS + MAX_OFF_SYMBOLS];
+    uint64_t v;
+    int i, n = rd->nchars + rd->nlens + rd->offSyms;
+    
+    if ((rd->flags & STREAM_CHECKSUM) && rd->summed){
+        if (bitIO_read_bits(file, &v, SUM_BITS) < SUM_BITS)
+            return -1;
+        rd->blockSum = v;
+        rd->check = 1;
+        rd->summed = 0;
+    }
+    
+    if (bitIO_read_bits(file, &v, BLOCK_COUNT_BITS) < BLOCK_COUNT_BITS)
+        return -1;
+    rd->left = v;
+    rd->stored = 0;
+    if (v == 0 && !(rd->flags & STREAM_STORED))
+        return 0;
+    
+    if (bitIO_read_bits(file, &v, 1) < 1)
+        return -1;
+    rd->coded = (rd->left > 0) ? v : 0;
+    if (rd->left == 0){
+        if (v == 0){
+            if (!(rd->flags & STREAM_CHECKSUM))
+                return 0;
+            if (bitIO_read_bits(file, &v, SUM_BITS) < SUM_BITS)
+                return -1;
+            rd->streamSum = v;
+            return 0;
+        }
+        /* a stored block: its bytes start at the next byte */
+        if (bitIO_read_bits(file, &v, STORED_LEN_BITS) < STORED_LEN_BITS)
+            return -1;
+        rd->left = v + 1;
+        rd->stored = 1;
+        rd->summed = 1;
+        bitIO_skip_bits(file, bitIO_peek_bits(file, &v) & 7);
+        return 1;
+    }
+    rd->summed = 1;
+    if (rd->coded == 0)
+        return 1;
+    if (!(rd->flags & STREAM_HUFFMAN))
+        return -1;
+    
+    for (i = 0; i < n; i++){
+        if (bitIO_read_bits(file, &v, LENGTH_BITS) < LENGTH_BITS)
+            return -1;
+        len[i] = v;
+    }
+    
+    return (readerTables(rd, len) < 0) ? -1 : 1;
+}
+
+/***************************************************************************
+ *                           READ TOKEN FUNCTION
+ * Name         : readToken - read the next token of the stream
+ * Parameters   : file - compressed stream
+ *                rd - token reader
+ *                t - where the token goes
+ * Returned     : 1 on success, 0 at the end of the stream, -1 if the
+ *                stream is corrupted; 2 at a stored block, whose rd->left
+ *                bytes are next
+ ***************************************************************************/
+static inline int readToken(struct bitFILE *file, struct tokenReader *rd, struct token *t)
+{
+    uint64_t bits;
+    int avail, used;
+    
+    if (!rd->blocks){
+        /* the padding of the last byte is shorter than any token */
+        avail = bitIO_peek_bits(file, &bits);
+        used = fixedToken(rd, bits, t);
+        if (used > avail)
+            return (avail < 8) ? 0 : -1;
+        bitIO_skip_bits(file, used);
+        return 1;
+    }
+    
+    if (rd->left == 0 && (used = readBlock(file, rd)) <= 0)
+        return used;
+    if (rd->stored)
+        return 2;
+    
+    avail = bitIO_peek_bits(file, &bits);
+    used = rd->coded ? huffToken(rd, bits, t) : fixedToken(rd, bits, t);
+    if (used < 0 || used > avail)
+        return -1;
+    bitIO_skip_bits(file, used);
+    rd->left--;
+    
+    return 1;
+}
+
+/***************************************************************************
+ *                          DECODE SINK FUNCTION
+ * Name         : decodeSink - decompress a stream into the decoder output.
+ *                A memory output is itself the decoder's buffer; a file is
+ *                written DECODE_BLOCK bytes at a time, keeping the last
+ *                SB_SIZE bytes in the buffer for the next matches. With a
+ *                preset dictionary, its end is in the buffer before the
+ *                data, so a memory output is written as a file.
+ * Parameters   : file - compressed stream
+ *                out - output of the decoder
+ *                dict - the dictionary of the encoder (NULL for none)
+ *                dictLen - its size
+ * Returned     : 0 on success, -1 if the stream is corrupted or needs
+ *                another dictionary
+ ***************************************************************************/
+static int decodeSink(struct bitFILE *file, struct sink *out, const unsigned char *dict, size_t dictLen)
+{
+    /* variables */
+    struct token t;
+    size_t back = 0, keep, size, need, n;
+    size_t written = 0;         /* bytes of the buffer already in the file */
+    size_t hashed = 0;          /* bytes of the buffer already in the checksum */
+    unsigned char *buffer;
+    struct tokenReader rd;
+    uint64_t header, sb, la, id;
+    int SB_SIZE, LA_SIZE, ret, next, direct;
+    STATS_LOCAL(prev);
+    
+    /* read header */
+    if (bitIO_read_bits(file, &header, 2 * MAX_BIT_BUFFER) < 2 * MAX_BIT_BUFFER || (ret = readerInit(&rd, header)) < 0)
+        return -1;
+    if (ret > 0 && (bitIO_read_bits(file, &sb, WIDE_SB_BITS) < WIDE_SB_BITS || bitIO_read_bits(file, &la, WIDE_LA_BITS) < WIDE_LA_BITS
+        || readerWide(&rd, sb, la) < 0))
+        return -1;
+    if ((rd.flags & STREAM_DICT) && (bitIO_read_bits(file, &id, DICT_ID_BITS) < DICT_ID_BITS || dict == NULL
+        || id != lz77_dict_id(dict, dictLen)))
+        return -1;
+    SB_SIZE = rd.sb_size;
+    LA_SIZE = rd.la_size;
+    
+    direct = (out->file == NULL && !(rd.flags & STREAM_DICT));
+    if (direct){
+        buffer = out->mem;
+        size = out->size;
+    }else{
+        size = SB_SIZE + LA_SIZE + ((out->file == NULL && out->size < DECODE_BLOCK) ? out->size : DECODE_BLOCK);
+        if ((buffer = malloc(size + COPY_SLACK)) == NULL)
+            return -1;
+    }
+    
+    /* the matches may point back in the end of the dictionary, which is
+       not output */
+    if (rd.flags & STREAM_DICT){
+        back = written = hashed = (dictLen < (size_t)SB_SIZE) ? dictLen : (size_t)SB_SIZE;
+        memcpy(buffer, &(dict[dictLen - back]), back);
+    }
+    
+    /* read the codes from the input file */
+    STATS_ENTER(prev, PHASE_DECODE);
+    while((ret = readToken(file, &rd, &t)) > 0)
+    {
+        /* the block before is over: its bytes are all in the buffer */
+        if(rd.check){
+            readerHash(&rd, &(buffer[hashed]), back - hashed);
+            hashed = back;
+            if(readerCheck(&rd, rd.blockSum) < 0)
+                goto error;
+        }
+        
+        if(ret == 1){
+            STATS_TOKEN(t.len, t.off);
+            /* a match must point back inside the search buffer */
+            if(t.len >= LA_SIZE || (t.len > 0 && (t.off <= 0 || (size_t)t.off > back || t.off > SB_SIZE)))
+                goto error;
+        }
+        
+        /* a stored block fills what is left of the buffer at each pass */
+        need = (ret == 1) ? (size_t)t.len + 1 : 1;
+        if(back + need > size){
+            /* the memory output is too small */
+            if(direct){
+                out->err = 1;
+                goto error;
+            }
+            
+            /* write the block and move the search buffer at the beginning */
+            keep = (back < (size_t)SB_SIZE) ? back : (size_t)SB_SIZE;
+            STATS_SWITCH(PHASE_WRITE);
+            if(writeSink(out, &(buffer[written]), back - written) < 0)
+                goto error;
+            STATS_SWITCH(PHASE_DECODE);
+            readerHash(&rd, &(buffer[hashed]), back - hashed);
+            memmove(buffer, &(buffer[back - keep]), keep);
+            back = keep;
+            written = keep;
+            hashed = keep;
+        }
+        
+        if(ret == 2){
+            n = ((size_t)rd.left < size - back) ? (size_t)rd.left : size - back;
+            if(bitIO_read_bytes(file, &(buffer[back]), n) < (int)n)
+                goto error;
+            STATS_ADD(stored, n);
+            back += n;
+            rd.left -= n;
+            continue;
+        }
+        
+        /* reconstruct the original bytes: the wide copies may go past the
+           match, which is fine as long as the buffer has room for it */
+        if(t.len > 0){
+            if(back + t.len + COPY_SLACK <= size || !direct)
+                copyMatch(&(buffer[back]), t.off, t.len);
+            else
+                memmoveMatch(&(buffer[back]), t.off, t.len);
+        }
+        /* a match of the flagged format has no next char */
+        next = (rd.format == LZ77_TRIPLES || t.len == 0);
+        if(next)
+            buffer[back + t.len] = t.next;
+        back += t.len + next;
+    }
+    
+    if(ret < 0)
+        goto error;
+    if(rd.check){
+        readerHash(&rd, &(buffer[hashed]), back - hashed);
+        if(readerCheck(&rd, rd.blockSum) < 0)
+            goto error;
+    }
+    if((rd.flags & STREAM_CHECKSUM) && checksumDigest(&rd.chain) != rd.streamSum)
+        goto error;
+    
+    /* write the last block */
+    if(!direct){
+        STATS_SWITCH(PHASE_WRITE);
+        if(writeSink(out, &(buffer[written]), back - written) < 0)
+            goto error;
+        free(buffer);
+    }else
+        out->pos = back;
+    STATS_SWITCH(prev);
+    
+    return 0;
+    
+error:
+    if(!direct)
+        free(buffer);
+    STATS_SWITCH(prev);
+    return -1;
+}
+
+/***************************************************************************
+ *                            MATCH FUNCTION
+ * Name         : match - find the longest match and create the token
+ * Parameters   : tree - binary search tree
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                base - position of window[0]
+ *                la - absolute position of the lookahead
+ *                la_size - actual lookahead size
+ * Returned     : token of the best match
+ ***************************************************************************/
+struct token match(struct searchTree *tree, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int la, int la_size)
+{
+    /* variables */
+    struct token t;
+    struct ret r;
+    
+    /* find the longest match */
+    r = find(tree, window, wmask, base, la, la_size);
+    
+    /* create the token */
+    t.off = r.off;
+    t.len = r.len;
+    t.next = window[(la + r.len - base) & wmask];
+    
+    return t;
+}
+
+/***************************************************************************
+ *                                ENCODER
+ * The encoder is driven by its caller: input goes in the ring buffer as it
+ * comes, and a token is made only once more than 2 lookaheads are in the
+ * window (unless flushing), so that every position is looked up with a
+ * full lookahead whatever the input chunks are. The tokens are packed in a
+ * bounded output buffer, which the caller pulls. encodeSource drives it
+ * from a file or a memory area.
+ *
+ * The greedy levels take the longest match at each token; the fast ones
+ * also insert in the finder only the first positions of a match. The lazy
+ * levels look up every position: since every token costs the same bits,
+ * the best parse is the one with the fewest tokens, and the token at 'pos'
+ * may end at any position up to the greedy one, as it can use a prefix of
+ * its match. Among the last 'lazy' of them, the one from which the next
+ * match reaches farthest is taken. The top levels (LAZY_OPTIMAL) price
+ * every parse of the matches found instead, a few thousands positions at a
+ * time, and take the cheapest (see parseOptimal).
+ *
+ * The tokens are sent in blocks of up to HUFF_BLOCK. With STREAM_HUFFMAN
+ * each one has its own canonical Huffman codes of the next chars, of the
+ * lengths and of the offset buckets (see writeBlock). The input is sampled
+ * in segments of STORED_BLOCK bytes before it is parsed (see blockStored):
+ * a segment which doesn't look compressible is stored as it is, without
+ * looking up nor inserting its positions. At the end of each segment the
+ * block only goes on if its tokens are still smaller than its bytes; one
+ * whose tokens turn out larger is split before its last segment, which is
+ * stored (see writeBlock), so that no block is much larger than its input.
+ ***************************************************************************/
+struct lz77_encoder{
+    int LA_SIZE, SB_SIZE;
+    int format;                 /* LZ77_TRIPLES or LZ77_FLAGGED */
+    int offBits, lenBits;       /* bits of the token's fields */
+    int codec;                  /* how they are packed, see tokenCodec */
+    int reach;                  /* farthest offset they hold */
+    int minMatch;               /* shortest match (LZ77_FLAGGED) */
+    int insert;                 /* positions of a match inserted, 0 for all */
+    int lazy;                   /* token ends tried before the greedy one */
+    unsigned char *window;      /* ring buffer, or the view of the whole input */
+    unsigned char *ring;        /* the ring buffer */
+    unsigned int wsize;         /* size of the ring */
+    unsigned int wmask;         /* mask of the positions in the window */
+    unsigned int base;          /* position of window[0] */
+    int view;                   /* the window is a view, see encodeView */
+    struct finder f;
+    int sb_size;                /* actual search buffer size */
+    unsigned int pos, end;      /* absolute position of the lookahead and of the data's end */
+    unsigned int scan;          /* next position to look up (lazy levels) */
+    int *mlen, *moff;           /* matches of the positions from 'pos' to 'scan' */
+    unsigned int mmask;         /* size of their ring minus one */
+    struct matches *matches;    /* all their matches, for the optimal parse */
+    struct optNode *nodes;      /* positions of the optimal parse */
+    struct token *parsed;       /* its tokens, not put yet */
+    int nparsed, nextParsed;    /* their # and the next one */
+    int priced;                 /* the prices are the codes of the last block */
+    unsigned char charPrice[HUFF_MAX_SYMBOLS], lenPrice[HUFF_MAX_SYMBOLS];
+    unsigned char offPrice[MAX_OFF_SYMBOLS];
+    int flags;                  /* STREAM_* flags of the header */
+    struct token *tokens;       /* tokens of the block being made */
+    int ntok;                   /* their # */
+    unsigned int blockPos;      /* absolute position of its first byte */
+    unsigned int segPos;        /* and of its last segment */
+    int segTok;                 /* # of tokens before that segment */
+    int sampled;                /* the segment was sampled, see blockStored */
+    unsigned int *probe;        /* sampling table, see probeBlock */
+    struct checksum sum;        /* of the bytes of the block, see sumWindow */
+    struct checksum chain;      /* of the checksums of the blocks, see chainSum */
+    int nchars, nlens;          /* # of chars (and match lengths) and of lengths coded */
+    int offSyms;                /* # of offset buckets */
+    uint64_t acc;               /* bits not yet in the output */
+    int nbits;                  /* # of bits in the accumulator */
+    unsigned char *out;         /* compressed bytes not pulled yet */
+    size_t outCap, outStart, outEnd;
+    int started;                /* input was given, reset before another stream */
+    int finished;
+    const unsigned char *dict;  /* preset dictionary, NULL for none */
+    size_t dictLen;             /* its size */
+    struct lz77_alloc allocator;    /* the caller's allocator */
+    const struct lz77_alloc *alloc; /* &allocator, NULL for malloc */
+};
+
+/***************************************************************************
+ *                        PUT BITS FUNCTION
+ * Name         : putBits - append bits to the output, LSB first as bitIO
+ * Parameters   : e - encoder
+ *                value - the bits
+ *                n - # of bits (at most 56)
+ * The whole accumulator is stored at once, its complete bytes kept: up to
+ * PUT_SLACK bytes past the output's end are written.
+ ***************************************************************************/
+static inline void putBits(struct lz77_encoder *e, uint64_t value, int n)
+{
+    e->acc |= (value & ((1ULL << n) - 1)) << e->nbits;
+    e->nbits += n;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (e->nbits >= 8){
+        memcpy(&(e->out[e->outEnd]), &(e->acc), sizeof(uint64_t));
+        e->outEnd += e->nbits >> 3;
+        e->acc >>= e->nbits & ~7;
+        e->nbits &= 7;
+    }
+#else
+    while (e->nbits >= 8){
+        e->out[e->outEnd++] = (unsigned char)e->acc;
+        e->acc >>= 8;
+        e->nbits -= 8;
+    }
+#endif
+}
+
+/***************************************************************************
+ *                         ENCODER DICT FUNCTION
+ * Name         : encoderDict - preload the search buffer with the end of a
+ *                preset dictionary, as if it had just been encoded: its
+ *                positions go in the finder and the first matches of the
+ *                data may point back in it. The decoder does the same.
+ * Parameters   : e - encoder, just created
+ *                dict - the dictionary
+ *                len - its size
+ ***************************************************************************/
+static void encoderDict(struct lz77_encoder *e, const unsigned char *dict, size_t len)
+{
+    size_t n = (len < (size_t)e->reach) ? len : (size_t)e->reach;
+    struct source src = {NULL, &(dict[len - n]), n, 0};
+    int eof = 0, la_size;
+    
+    fillWindow(&src, e->window, e->wmask, e->LA_SIZE, encoderKeep(e), &e->end, &eof);
+    probeBlock(e, e->pos, e->end, NULL);
+    for (; e->pos != e->end; e->pos++){
+        la_size = (e->end - e->pos > (unsigned int)e->LA_SIZE) ? e->LA_SIZE : (int)(e->end - e->pos);
+        finderSlide(&e->f, 0, e->pos, la_size, e->reach);
+        e->sb_size++;
+    }
+    e->scan = e->blockPos = e->segPos = e->pos;
+}
+
+/***************************************************************************
+ *                         ENCODER START FUNCTION
+ * Name         : encoderStart - begin a stream: the header, with the sizes
+ *                after it if they don't fit, and the ID of the dictionary,
+ *                whose end is preloaded
+ * Parameters   : e - encoder, with the positions of the stream set
+ ***************************************************************************/
+static void encoderStart(struct lz77_encoder *e)
+{
+    int wide = (e->flags & STREAM_WIDE);
+    
+    e->blockPos = e->segPos = e->pos;
+    e->segTok = 0;
+    e->sampled = 0;
+    e->nparsed = e->nextParsed = 0;
+    blockPrices(e, NULL, 0);
+    checksumInit(&e->sum);
+    checksumInit(&e->chain);
+    putBits(e, wide ? 0 : e->SB_SIZE, MAX_BIT_BUFFER);
+    putBits(e, wide ? 0 : e->LA_SIZE, 8);
+    putBits(e, e->flags | (e->format << STREAM_FORMAT_SHIFT), 8);
+    if (wide){
+        putBits(e, e->SB_SIZE, WIDE_SB_BITS);
+        putBits(e, e->LA_SIZE, WIDE_LA_BITS);
+    }
+    if (e->flags & STREAM_DICT){
+        putBits(e, lz77_dict_id(e->dict, e->dictLen), DICT_ID_BITS);
+        encoderDict(e, e->dict, e->dictLen);
+    }
+}
+
+/***************************************************************************
+ *                       ENCODER CREATE FUNCTION
+ * Name         : lz77_encoder_create - create a streaming encoder. The
+ *                dictionary of the parameters is not copied: it must stay
+ *                there as long as the encoder, which preloads it again at
+ *                each reset.
+ * Parameters   : p - encoder parameters
+ * Returned     : the encoder, NULL on errors
+ ***************************************************************************/
+struct lz77_encoder *lz77_encoder_create(const struct lz77_params *p)
+{
+    struct lz77_encoder *e;
+    const struct level *l;
+    const struct lz77_alloc *a = p->alloc;
+    int la = (p->la == -1) ? DEFAULT_LA_SIZE : p->la;
+    int sb = (p->sb == -1) ? DEFAULT_SB_SIZE : p->sb;
+    int wide = (la > HEADER_MAX_LA || sb > HEADER_MAX_SB), n;
+    
+    if (p->level != -1 && (p->level < MIN_LEVEL || p->level > MAX_LEVEL))
+        return NULL;
+    if (p->format != LZ77_TRIPLES && p->format != LZ77_FLAGGED)
+        return NULL;
+    /* the Huffman tokens must fit in a refill of the decoder's bit buffer */
+    if (la < 1 || la > LZ77_MAX_LA || sb < 2 || sb > LZ77_MAX_SB || (wide && p->huffman))
+        return NULL;
+    l = &(levels[(p->level == -1) ? DEFAULT_LEVEL : p->level]);
+    if ((e = memCalloc(a, sizeof(struct lz77_encoder))) == NULL)
+        return NULL;
+    if (a != NULL){
+        e->allocator = *a;
+        e->alloc = &e->allocator;
+    }
+    
+    e->LA_SIZE = la;
+    e->SB_SIZE = sb;
+    e->format = p->format;
+    e->offBits = bitof(e->SB_SIZE);
+    e->lenBits = bitof(e->LA_SIZE);
+    e->codec = tokenCodec(e->offBits, e->lenBits);
+    e->minMatch = minMatch(e->offBits, e->lenBits);
+    /* a power of two search buffer is one offset more than its bits hold */
+    e->reach = (e->SB_SIZE < (1 << e->offBits)) ? e->SB_SIZE : (1 << e->offBits) - 1;
+    /* the binary search tree deletes what it inserted, it can't skip */
+    e->insert = (p->finder == LZ77_TREE) ? 0 : l->insert;
+    e->lazy = l->lazy;
+    
+    /* the window is a ring buffer, a power of two large enough to read as
+       much input as the search buffer and the lookahead hold at once, or
+       WINDOW_READ bytes for a large window, and to keep the input of a
+       block until it is written. Its pages are only touched as the input
+       comes, as the finders' arrays. */
+    for (e->wsize = MIN_WINDOW_SIZE; e->wsize < (unsigned int)(e->SB_SIZE + e->LA_SIZE
+         + ((e->SB_SIZE + e->LA_SIZE < WINDOW_READ) ? e->SB_SIZE + e->LA_SIZE : WINDOW_READ))
+         || e->wsize < (unsigned int)(e->SB_SIZE + 2 * (e->LA_SIZE + STORED_BLOCK)); e->wsize <<= 1){}
+    e->ring = e->window = memCalloc(e->alloc, e->wsize + e->LA_SIZE);
+    e->wmask = e->wsize - 1;
+    e->flags = STREAM_STORED | (p->huffman ? STREAM_HUFFMAN : 0) | (wide ? STREAM_WIDE : 0)
+               | ((p->dict != NULL && p->dictLen > 0) ? STREAM_DICT : 0) | (p->checksum ? STREAM_CHECKSUM : 0);
+    e->dict = p->dict;
+    e->dictLen = p->dictLen;
+    e->offSyms = bitLength(e->SB_SIZE);
+    /* the flagged format codes the match lengths with the chars */
+    if (e->format == LZ77_FLAGGED){
+        e->nchars = 256 + ((e->LA_SIZE > e->minMatch) ? e->LA_SIZE - e->minMatch : 0);
+        e->nlens = 0;
+    }else{
+        e->nchars = 256;
+        e->nlens = e->LA_SIZE;
+    }
+    e->outCap = STREAM_BUFFER + blockBound(e);
+    e->tokens = memAlloc(e->alloc, HUFF_BLOCK * sizeof(struct token));
+    e->probe = memCalloc(e->alloc, (1 << PROBE_BITS) * sizeof(unsigned int));
+    e->out = memAlloc(e->alloc, e->outCap + PUT_SLACK);
+    if (e->lazy){
+        /* the greedy end of a token is at most a lookahead away, and the
+           optimal parse looks up to 2 * OPT_SPAN positions ahead */
+        n = (e->lazy == LAZY_OPTIMAL) ? 2 * OPT_SPAN + e->LA_SIZE + 2 : e->LA_SIZE + 2;
+        for (e->mmask = 1; e->mmask < (unsigned int)n; e->mmask <<= 1){}
+        e->mlen = memAlloc(e->alloc, e->mmask * sizeof(int));
+        e->moff = memAlloc(e->alloc, e->mmask * sizeof(int));
+        e->mmask--;
+    }
+    if (e->lazy == LAZY_OPTIMAL){
+        e->matches = memAlloc(e->alloc, (e->mmask + 1) * sizeof(struct matches));
+        e->nodes = memAlloc(e->alloc, (2 * OPT_SPAN + e->LA_SIZE + 2) * sizeof(struct optNode));
+        e->parsed = memAlloc(e->alloc, (2 * OPT_SPAN + 1) * sizeof(struct token));
+    }
+    if (e->window == NULL || e->out == NULL || (e->lazy && (e->mlen == NULL || e->moff == NULL))
+        || (e->lazy == LAZY_OPTIMAL && (e->matches == NULL || e->nodes == NULL || e->parsed == NULL))
+        || e->tokens == NULL || e->probe == NULL
+        || createFinder(&e->f, p, (p->depth > 0) ? p->depth : l->depth, e->reach, e->window, e->wmask, e->alloc) < 0){
+        lz77_encoder_destroy(e);
+        return NULL;
+    }
+    
+    /* positions start far enough from 0, the match finders' "no position" */
+    e->pos = e->end = e->scan = e->wsize;
+    encoderStart(e);
+    
+    return e;
+}
+
+/***************************************************************************
+ *                        ENCODER RESET FUNCTION
+ * Name         : lz77_encoder_reset - drop the stream being encoded and
+ *                begin another one with the same parameters, without any
+ *                allocation. Nothing is cleared: the new positions start a
+ *                search buffer after the last one of the old stream, so that
+ *                the match finders see its positions as too far away.
+ * Parameters   : e - encoder
+ ***************************************************************************/
+void lz77_encoder_reset(struct lz77_encoder *e)
+{
+    e->pos = e->end = e->scan = e->end + e->reach + 1;
+    e->window = e->ring;
+    e->wmask = e->wsize - 1;
+    e->base = 0;
+    e->view = 0;
+    e->f.window = e->window;
+    e->f.wmask = e->wmask;
+    e->f.base = e->base;
+    finderReset(&e->f);
+    encoderNormalize(e);
+    
+    e->sb_size = 0;
+    e->ntok = 0;
+    e->acc = 0;
+    e->nbits = 0;
+    e->outStart = e->outEnd = 0;
+    e->started = 0;
+    e->finished = 0;
+    encoderStart(e);
+}
+
+void lz77_encoder_destroy(struct lz77_encoder *e)
+{
+    if (e == NULL)
+        return;
+    destroyFinder(&e->f);
+    memFree(e->alloc, e->ring);
+    memFree(e->alloc, e->out);
+    memFree(e->alloc, e->mlen);
+    memFree(e->alloc, e->moff);
+    memFree(e->alloc, e->matches);
+    memFree(e->alloc, e->nodes);
+    memFree(e->alloc, e->parsed);
+    memFree(e->alloc, e->tokens);
+    memFree(e->alloc, e->probe);
+    memFree(e->alloc, e);
+}
+
+/***************************************************************************
+ *                          ENCODER KEEP FUNCTION
+ * Name         : encoderKeep - oldest position still needed in the window,
+ *                by the finder or by the last segment of the block being
+ *                made, which may be stored (the tokens not made yet are
+ *                after its start)
+ * Parameters   : e - encoder
+ * Returned     : absolute position
+ ***************************************************************************/
+static unsigned int encoderKeep(const struct lz77_encoder *e)
+{
+    unsigned int from = e->scan - e->sb_size;
+    
+    return (from < e->segPos) ? from : e->segPos;
+}
+
+/***************************************************************************
+ *                         OUTPUT ROOM FUNCTION
+ * Name         : outputRoom - make room in the output buffer
+ * Parameters   : e - encoder
+ *                room - # of bytes needed
+ * Returned     : 1 if there is room, 0 if the output must be pulled first
+ ***************************************************************************/
+static int outputRoom(struct lz77_encoder *e, size_t room)
+{
+    if (e->outEnd + room <= e->outCap)
+        return 1;
+    memmove(e->out, &(e->out[e->outStart]), e->outEnd - e->outStart);
+    e->outEnd -= e->outStart;
+    e->outStart = 0;
+    
+    return (e->outEnd + room <= e->outCap);
+}
+
+/***************************************************************************
+ *                          BLOCK BOUND FUNCTION
+ * Name         : blockBound - max size of the blocks written at once: the
+ *                header, the tables and the longest tokens of a block (codes
+ *                of HUFF_MAX_BITS and all the extra bits of the offset, or
+ *                the fixed fields), with its last segment and the next one
+ *                as the largest stored blocks, and their checksums
+ * Parameters   : e - encoder
+ * Returned     : # of bytes
+ ***************************************************************************/
+static size_t blockBound(const struct lz77_encoder *e)
+{
+    size_t coded = 3 * HUFF_MAX_BITS + ((e->offSyms > 0) ? e->offSyms - 1 : 0);
+    size_t fixed = e->offBits + e->lenBits + 8;
+    size_t bits = BLOCK_COUNT_BITS + 1 + LENGTH_BITS * (e->nchars + e->nlens + e->offSyms);
+    size_t tokens = (bits + (size_t)HUFF_BLOCK * ((coded > fixed) ? coded : fixed) + 7) / 8 + 1;
+    size_t stored = (BLOCK_COUNT_BITS + 1 + STORED_LEN_BITS + 7) / 8 + 1 + STORED_MAX;
+    size_t sums = (e->flags & STREAM_CHECKSUM) ? 3 * SUM_BITS / 8 : 0;
+    
+    return tokens + 2 * stored + sums;
+}
+
+/***************************************************************************
+ *                           PUT FIXED FUNCTION
+ * Name         : putFixed - write a token of fixed fields (see tokenCodec),
+ *                packed with the widths of the encoder's codec
+ * Parameters   : e - encoder
+ *                t - the token
+ *                offBits - bits of the offset field
+ *                lenBits - bits of the length field
+ ***************************************************************************/
+SPECIALIZED void putFields(struct lz77_encoder *e, const struct token *t, const int offBits, const int lenBits)
+{
+    if (e->format == LZ77_FLAGGED){
+        if (t->len == 0)
+            putBits(e, (unsigned char)t->next << 1, 9);
+        else
+            putBits(e, 1 | (uint64_t)t->off << 1 | (uint64_t)(t->len - minMatch(offBits, lenBits)) << (1 + offBits),
+                    1 + offBits + lenBits);
+        return;
+    }
+    putBits(e, (uint64_t)t->off | (uint64_t)t->len << offBits | (uint64_t)(unsigned char)t->next << (offBits + lenBits),
+            offBits + lenBits + 8);
+}
+
+static inline void putFixed(struct lz77_encoder *e, const struct token *t)
+{
+    switch (e->codec){
+        case CODEC_12_4:
+            putFields(e, t, 12, 4);
+            break;
+        case CODEC_16_8:
+            putFields(e, t, 16, 8);
+            break;
+        default:
+            putFields(e, t, e->offBits, e->lenBits);
+    }
+}
+
+/***************************************************************************
+ *                          PUT STORED FUNCTION
+ * Name         : putStored - write the input of the segment as it is:
+ *
+ *     +-------------+--------+--------------+---------+----------------+
+ *     |      0      | stored | size minus 1 | padding | bytes          |
+ *     +-------------+--------+--------------+---------+----------------+
+ *           16          1           16        to a byte
+ *
+ *                The bytes are at a byte boundary, so that the decoder
+ *                copies them with memcpy.
+ * Parameters   : e - encoder
+ *                n - # of bytes from its start, at most STORED_MAX
+ ***************************************************************************/
+static void putStored(struct lz77_encoder *e, unsigned int n)
+{
+    unsigned int idx = (e->segPos - e->base) & e->wmask, first = n;
+    
+    putBits(e, 0, BLOCK_COUNT_BITS);
+    putBits(e, 1, 1);
+    putBits(e, n - 1, STORED_LEN_BITS);
+    putBits(e, 0, (8 - e->nbits) & 7);
+    
+    /* the block may wrap around the end of the ring */
+    if (!e->view && idx + n > e->wsize)
+        first = e->wsize - idx;
+    memcpy(&(e->out[e->outEnd]), &(e->window[idx]), first);
+    memcpy(&(e->out[e->outEnd + first]), e->window, n - first);
+    e->outEnd += n;
+    STATS_ADD(stored, n);
+}
+
+/***************************************************************************
+ *                          SUM WINDOW FUNCTION
+ * Name         : sumWindow - add input of the block being made to its
+ *                checksum, while it is still in the window
+ * Parameters   : e - encoder
+ *                from - absolute position of the first byte
+ *                n - # of bytes
+ ***************************************************************************/
+static void sumWindow(struct lz77_encoder *e, unsigned int from, unsigned int n)
+{
+    unsigned int idx = (from - e->base) & e->wmask, first = n;
+    
+    if (!(e->flags & STREAM_CHECKSUM))
+        return;
+    if (!e->view && idx + n > e->wsize)
+        first = e->wsize - idx;
+    checksumUpdate(&e->sum, &(e->window[idx]), first);
+    checksumUpdate(&e->sum, e->window, n - first);
+}
+
+/***************************************************************************
+ *                            PUT SUM FUNCTION
+ * Name         : putSum - write the checksum of the block just written
+ *                (see readerCheck), and start the one of the next block
+ * Parameters   : e - encoder
+ ***************************************************************************/
+static void putSum(struct lz77_encoder *e)
+{
+    uint32_t sum;
+    
+    if (!(e->flags & STREAM_CHECKSUM))
+        return;
+    sum = checksumDigest(&e->sum);
+    putBits(e, sum, SUM_BITS);
+    chainSum(&e->chain, sum);
+    checksumInit(&e->sum);
+}
+
+/***************************************************************************
+ *                          BLOCK BITS FUNCTION
+ * Name         : blockBits - size of the first tokens of the block, with the
+ *                fixed fields and, in a STREAM_HUFFMAN stream, coded with
+ *                the lengths of the codes made for them
+ * Parameters   : e - encoder
+ *                ntok - # of tokens
+ *                c - where the lengths of the codes go
+ *                coded - set if the coded tokens are the smaller
+ * Returned     : # of bits of the smaller, without the block's header
+ ***************************************************************************/
+static uint64_t blockBits(const struct lz77_encoder *e, int ntok, struct blockCodes *c, int *coded)
+{
+    /* variables */
+    unsigned int fchar[HUFF_MAX_SYMBOLS] = {0}, flen[HUFF_MAX_SYMBOLS] = {0}, foff[MAX_OFF_SYMBOLS] = {0};
+    const struct token *t;
+    uint64_t bits, fixed = 0;
+    int i;
+    
+    for (i = 0; i < ntok; i++){
+        t = &(e->tokens[i]);
+        if (e->format == LZ77_FLAGGED)
+            fixed += (t->len > 0) ? 1 + e->offBits + e->lenBits : 9;
+        else
+            fixed += e->offBits + e->lenBits + 8;
+    }
+    *coded = 0;
+    if (!(e->flags & STREAM_HUFFMAN))
+        return fixed;
+    
+    /* the symbols of the codes, which fit in their tables as a Huffman
+       stream is never wide: its lookahead is at most 255 */
+    for (i = 0; i < ntok; i++){
+        t = &(e->tokens[i]);
+        if (e->format == LZ77_FLAGGED)
+            fchar[(t->len > 0) ? 256 + t->len - e->minMatch : (unsigned char)t->next]++;
+        else{
+            fchar[(unsigned char)t->next]++;
+            flen[t->len]++;
+        }
+        if (t->len > 0)
+            foff[bitLength(t->off) - 1]++;
+    }
+    
+    huffLengths(fchar, e->nchars, c->chars.len);
+    huffLengths(flen, e->nlens, c->lens.len);
+    huffLengths(foff, e->offSyms, c->offs.len);
+    
+    /* size of the coded tokens */
+    bits = LENGTH_BITS * (e->nchars + e->nlens + e->offSyms);
+    for (i = 0; i < e->nchars; i++)
+        bits += (uint64_t)fchar[i] * c->chars.len[i];
+    for (i = 0; i < e->nlens; i++)
+        bits += (uint64_t)flen[i] * c->lens.len[i];
+    for (i = 0; i < e->offSyms; i++)
+        bits += (uint64_t)foff[i] * (c->offs.len[i] + i);
+    *coded = (bits < fixed);
+    
+    return *coded ? bits : fixed;
+}
+
+/***************************************************************************
+ *                          PUT TOKENS FUNCTION
+ * Name         : putTokens - write the first tokens of the block:
+ *
+ *     +-------------+-------+--------------------------+---------------+
+ *     | # of tokens | coded | lengths of the codes (*) | tokens        |
+ *     +-------------+-------+--------------------------+---------------+
+ *           16          1       4 bits per symbol
+ *
+ *                (*) of the 256 chars, of the lengths [0, LA_SIZE) and of
+ *                the offset buckets, only if coded. A coded token is the
+ *                code of its length, then the code of the bucket of its
+ *                offset (the offset's bit length minus one) and the bits of
+ *                the offset below the leading one, if there is a match, then
+ *                the code of the next char. In the flagged format the
+ *                lengths [minMatch, LA_SIZE) are coded as chars 256 and up,
+ *                with no table of their own: a token is the code of a char,
+ *                or the code of a length and the offset. Only the blocks of
+ *                a STREAM_HUFFMAN stream are coded, and only if the codes
+ *                are smaller than the fixed fields; otherwise the tokens are
+ *                written as in a plain stream. A block of 0 tokens which is
+ *                not stored (see putStored) ends the stream.
+ * Parameters   : e - encoder
+ *                ntok - # of tokens
+ *                c - lengths of the codes, from blockBits
+ *                coded - the tokens are coded
+ ***************************************************************************/
+static void putTokens(struct lz77_encoder *e, int ntok, struct blockCodes *c, int coded)
+{
+    const struct token *t;
+    int i, b, s;
+    
+    putBits(e, ntok, BLOCK_COUNT_BITS);
+    putBits(e, coded, 1);
+    if (!coded){
+        for (i = 0; i < ntok; i++)
+            putFixed(e, &(e->tokens[i]));
+        return;
+    }
+    
+    for (i = 0; i < e->nchars; i++)
+        putBits(e, c->chars.len[i], LENGTH_BITS);
+    for (i = 0; i < e->nlens; i++)
+        putBits(e, c->lens.len[i], LENGTH_BITS);
+    for (i = 0; i < e->offSyms; i++)
+        putBits(e, c->offs.len[i], LENGTH_BITS);
+    huffCodes(&c->chars, e->nchars);
+    huffCodes(&c->lens, e->nlens);
+    huffCodes(&c->offs, e->offSyms);
+    
+    for (i = 0; i < ntok; i++){
+        t = &(e->tokens[i]);
+        if (e->format == LZ77_FLAGGED){
+            s = (t->len > 0) ? 256 + t->len - e->minMatch : (unsigned char)t->next;
+            putBits(e, c->chars.code[s], c->chars.len[s]);
+        }else
+            putBits(e, c->lens.code[t->len], c->lens.len[t->len]);
+        if (t->len > 0){
+            b = bitLength(t->off) - 1;
+            putBits(e, c->offs.code[b], c->offs.len[b]);
+            putBits(e, t->off, b);
+        }
+        if (e->format == LZ77_TRIPLES){
+            s = (unsigned char)t->next;
+            putBits(e, c->chars.code[s], c->chars.len[s]);
+        }
+    }
+}
+
+/***************************************************************************
+ *                          BLOCK PRICES FUNCTION
+ * Name         : blockPrices - price the symbols of the next tokens with
+ *                codes made for the tokens of a block, if they were coded;
+ *                the symbols not used get the longest code. Before any
+ *                code a STREAM_HUFFMAN stream prices the chars 8 bits, the
+ *                lengths and the offset buckets their bits, and the offsets
+ *                their bits below the leading one.
+ * Parameters   : e - encoder
+ *                c - lengths of the codes, from blockBits, NULL for none
+ *                coded - the tokens are coded
+ ***************************************************************************/
+static void blockPrices(struct lz77_encoder *e, const struct blockCodes *c, int coded)
+{
+    int i;
+    
+    e->priced = (c == NULL) ? (e->flags & STREAM_HUFFMAN) != 0 : coded;
+    if (!e->priced)
+        return;
+    for (i = 0; i < e->nchars; i++)
+        e->charPrice[i] = (c == NULL) ? ((i < 256) ? 8 : e->lenBits) : c->chars.len[i] ? c->chars.len[i] : HUFF_MAX_BITS;
+    for (i = 0; i < e->nlens; i++)
+        e->lenPrice[i] = (c == NULL) ? e->lenBits : c->lens.len[i] ? c->lens.len[i] : HUFF_MAX_BITS;
+    for (i = 0; i < e->offSyms; i++)
+        e->offPrice[i] = ((c == NULL) ? bitLength(e->offSyms) : c->offs.len[i] ? c->offs.len[i] : HUFF_MAX_BITS) + i;
+}
+
+/***************************************************************************
+ *                          WRITE BLOCK FUNCTION
+ * Name         : writeBlock - write the block being made. If its tokens
+ *                are larger than its bytes (and the padding of a stored
+ *                block), its last segment is stored instead of them, after
+ *                the tokens before it: those were smaller than their bytes
+ *                when the segment began (see tokenRoom), and they are the
+ *                same tokens, so no block is larger than its input but for
+ *                its header.
+ * Parameters   : e - encoder
+ ***************************************************************************/
+static void writeBlock(struct lz77_encoder *e)
+{
+    struct blockCodes c;
+    uint64_t bits;
+    unsigned int n;
+    int coded;
+    STATS_LOCAL(prev);
+    
+    STATS_ENTER(prev, PHASE_HUFFMAN);
+    bits = blockBits(e, e->ntok, &c, &coded);
+    if (e->segTok > 0 && 8 * (uint64_t)(e->pos - e->blockPos) + STORED_LEN_BITS + 7 < bits){
+        bits = blockBits(e, e->segTok, &c, &coded);
+        putTokens(e, e->segTok, &c, coded);
+        putSum(e);
+        e->ntok -= e->segTok;
+        memmove(e->tokens, &(e->tokens[e->segTok]), e->ntok * sizeof(struct token));
+        e->segTok = 0;
+        e->blockPos = e->segPos;
+        bits = blockBits(e, e->ntok, &c, &coded);
+    }
+    
+    n = e->pos - e->blockPos;
+    sumWindow(e, e->segPos, e->pos - e->segPos);
+    if (e->segTok == 0 && n <= STORED_MAX && 8 * (uint64_t)n + STORED_LEN_BITS + 7 < bits)
+        putStored(e, n);
+    else{
+        putTokens(e, e->ntok, &c, coded);
+        blockPrices(e, &c, coded);
+    }
+    putSum(e);
+    e->ntok = 0;
+    e->segTok = 0;
+    e->blockPos = e->segPos = e->pos;
+    STATS_SWITCH(prev);
+}
+
+/***************************************************************************
+ *                           TOKEN ROOM FUNCTION
+ * Name         : tokenRoom - make room for the next token in the block,
+ *                written once full. At the end of a segment, the next one
+ *                is to be sampled and the block goes on only if its tokens
+ *                are still smaller than its bytes.
+ * Parameters   : e - encoder
+ * Returned     : 1 if there is room, 0 if the output must be pulled first
+ ***************************************************************************/
+static int tokenRoom(struct lz77_encoder *e)
+{
+    struct blockCodes c;
+    int coded;
+    
+    if (e->ntok < HUFF_BLOCK && e->pos - e->segPos < STORED_BLOCK)
+        return 1;
+    if (!outputRoom(e, blockBound(e)))
+        return 0;
+    if (e->pos - e->segPos >= STORED_BLOCK){
+        e->sampled = 0;
+        if (e->ntok < HUFF_BLOCK
+            && blockBits(e, e->ntok, &c, &coded) <= 8 * (uint64_t)(e->pos - e->blockPos) + STORED_LEN_BITS + 7){
+            sumWindow(e, e->segPos, e->pos - e->segPos);
+            e->segTok = e->ntok;
+            e->segPos = e->pos;
+            return 1;
+        }
+    }
+    writeBlock(e);
+    return 1;
+}
+
+/***************************************************************************
+ *                           PUT TOKEN FUNCTION
+ * Name         : putToken - keep a token for its block
+ * Parameters   : e - encoder
+ *                t - the token
+ ***************************************************************************/
+static void putToken(struct lz77_encoder *e, struct token t)
+{
+    STATS_TOKEN(t.len, t.off);
+    if (t.len == 0)
+        t.off = 0;
+    e->tokens[e->ntok++] = t;
+}
+
+/***************************************************************************
+ *                          PROBE BLOCK FUNCTION
+ * Name         : probeBlock - parse some input roughly, with a table of the
+ *                last position of each hash of 3 bytes: a position is a
+ *                match when the one of its hash, within reach, starts with
+ *                the same 3 bytes. The positions inside a match are neither
+ *                looked up nor kept. The table is only read by blockStored,
+ *                the finder is not touched.
+ * Parameters   : e - encoder
+ *                from - absolute position of the first byte
+ *                to - absolute position after the last one
+ *                freq - where the frequencies of the literals are added,
+ *                       NULL for none
+ ***************************************************************************/
+static void probeBlock(struct lz77_encoder *e, unsigned int from, unsigned int to, unsigned int *freq)
+{
+    const unsigned char *w = e->window;
+    unsigned int m = e->wmask, b = e->base, p = from, q, h, len, max;
+    
+    while (p < to){
+        max = (to - p < (unsigned int)e->LA_SIZE) ? to - p : (unsigned int)e->LA_SIZE - 1;
+        if (max >= 3){
+            h = ((unsigned int)w[(p - b) & m] | (unsigned int)w[(p + 1 - b) & m] << 8 | (unsigned int)w[(p + 2 - b) & m] << 16)
+                * 2654435761U >> (32 - PROBE_BITS);
+            q = e->probe[h];
+            e->probe[h] = p;
+            /* the position of another stream, or too far away, is not read */
+            if (q != 0 && q < p && p - q <= (unsigned int)e->reach && w[(q - b) & m] == w[(p - b) & m]
+                && w[(q + 1 - b) & m] == w[(p + 1 - b) & m] && w[(q + 2 - b) & m] == w[(p + 2 - b) & m]){
+                for (len = 3; len < max && w[(q + len - b) & m] == w[(p + len - b) & m]; len++){}
+                p += len;
+                continue;
+            }
+        }
+        if (freq != NULL)
+            freq[w[(p - b) & m]]++;
+        p++;
+    }
+}
+
+/***************************************************************************
+ *                          BLOCK STORED FUNCTION
+ * Name         : blockStored - guess whether the next 'n' bytes are worth
+ *                parsing. The probe misses many of the finder's matches and
+ *                the cost of the tokens depends on the parse, so only the
+ *                segments which look random are stored: the matches found
+ *                by probeBlock cover less than 1/STORED_GAIN of it, and a
+ *                Huffman code of the bytes left saves less than 1/STORED_GAIN
+ *                of them. Random or already compressed data is stored, any
+ *                other is parsed, and its block stored by writeBlock if its
+ *                tokens turn out larger than its bytes.
+ * Parameters   : e - encoder, at the beginning of a segment
+ *                n - # of bytes of the segment
+ * Returned     : 1 if the segment should be stored, 0 otherwise
+ ***************************************************************************/
+static int blockStored(struct lz77_encoder *e, unsigned int n)
+{
+    unsigned int freq[256] = {0};
+    unsigned char len[256];
+    uint64_t lits = 0, bits = 0;
+    int i;
+    
+    probeBlock(e, e->pos, e->pos + n, freq);
+    huffLengths(freq, 256, len);
+    for (i = 0; i < 256; i++){
+        lits += freq[i];
+        bits += (uint64_t)freq[i] * len[i];
+    }
+    
+    return n - lits < n / STORED_GAIN && bits >= 8 * lits - 8 * lits / STORED_GAIN;
+}
+
+/***************************************************************************
+ *                          SKIP BLOCK FUNCTION
+ * Name         : skipBlock - move past a segment stored without parsing it.
+ *                Its positions aren't inserted in the finder: the hash
+ *                chain and the binary tree can go on without them, the
+ *                binary search tree, which deletes what it inserted, starts
+ *                again empty.
+ * Parameters   : e - encoder, at the beginning of the segment
+ *                n - # of bytes of the segment
+ ***************************************************************************/
+static void skipBlock(struct lz77_encoder *e, unsigned int n)
+{
+    unsigned int from = (e->scan > e->pos) ? e->scan : e->pos;
+    
+    e->pos += n;
+    e->blockPos = e->segPos = e->pos;
+    e->nparsed = e->nextParsed = 0;
+    if (e->f.type == LZ77_TREE){
+        finderReset(&e->f);
+        e->sb_size = 0;
+        e->scan = e->pos;
+        return;
+    }
+    /* the skipped positions stay in the search buffer, for the window */
+    if (e->pos > from){
+        e->sb_size = (e->sb_size + (e->pos - from) < (unsigned int)e->reach) ? e->sb_size + (int)(e->pos - from) : e->reach;
+        e->scan = e->pos;
+    }
+}
+
+/***************************************************************************
+ *                       ENCODER NORMALIZE FUNCTION
+ * Name         : encoderNormalize - bring the positions back, by a multiple
+ *                of the ring size, once every couple of GB
+ * Parameters   : e - encoder
+ ***************************************************************************/
+static void encoderNormalize(struct lz77_encoder *e)
+{
+    unsigned int n;
+    int i;
+    
+    if (e->pos < NORMALIZE_POS)
+        return;
+    STATS_ADD(normalizes, 1);
+    n = (e->pos - e->wsize) & ~(e->wsize - 1);
+    finderNormalize(&e->f, n);
+    for (i = 0; i < (1 << PROBE_BITS); i++)
+        e->probe[i] = (e->probe[i] > n) ? e->probe[i] - n : 0;
+    /* a ring maps the positions the same way, a view moves with them */
+    if (e->view){
+        e->base -= n;
+        e->f.base = e->base;
+    }
+    e->pos -= n;
+    e->end -= n;
+    e->scan -= n;
+    e->blockPos -= n;
+    e->segPos -= n;
+}
+
+/***************************************************************************
+ *                          SCAN TO FUNCTION
+ * Name         : scanTo - look up the matches of the positions up to 'to'
+ *                (or the end of the data), inserting them in the finder
+ * Parameters   : e - encoder
+ *                to - absolute position
+ ***************************************************************************/
+static void scanTo(struct lz77_encoder *e, unsigned int to)
+{
+    struct token t;
+    int la_size;
+    
+    while (e->scan <= to && e->scan != e->end){
+        la_size = (e->end - e->scan > (unsigned int)e->LA_SIZE) ? e->LA_SIZE : (int)(e->end - e->scan);
+        t = finderMatch(&e->f, e->scan, la_size, (e->matches != NULL) ? &(e->matches[e->scan & e->mmask]) : NULL);
+        e->mlen[e->scan & e->mmask] = t.len;
+        e->moff[e->scan & e->mmask] = t.off;
+        
+        finderSlide(&e->f, e->sb_size == e->reach, e->scan, la_size, e->reach);
+        if (e->sb_size < e->reach)
+            e->sb_size++;
+        e->scan++;
+    }
+}
+
+/***************************************************************************
+ *                          TOKEN PRICE FUNCTION
+ * Name         : tokenPrice - bits of a token, with the fixed fields or with
+ *                the codes of the last block (see blockPrices)
+ * Parameters   : e - encoder
+ *                len - length of the match, 0 for none
+ *                off - its offset
+ *                next - next char (the literal in the flagged format)
+ * Returned     : # of bits
+ ***************************************************************************/
+static inline unsigned int tokenPrice(const struct lz77_encoder *e, int len, int off, unsigned char next)
+{
+    unsigned int bits;
+    
+    if (!e->priced){
+        if (e->format == LZ77_TRIPLES)
+            return e->offBits + e->lenBits + 8;
+        return (len > 0) ? 1 + e->offBits + e->lenBits : 9;
+    }
+    if (e->format == LZ77_FLAGGED)
+        bits = e->charPrice[(len > 0) ? 256 + len - e->minMatch : next];
+    else
+        bits = e->lenPrice[len] + e->charPrice[next];
+    if (len > 0)
+        bits += e->offPrice[bitLength(off) - 1];
+    
+    return bits;
+}
+
+/***************************************************************************
+ *                         PARSE OPTIMAL FUNCTION
+ * Name         : parseOptimal - parse the next positions at the lowest
+ *                price. Going forward from 'pos', each position gets the
+ *                cheapest parse reaching it: the one of a position before
+ *                it, followed by a token ending there, a literal or a
+ *                match of that position (at least minMatch long in the
+ *                flagged format) of any length up to the longest, with
+ *                the nearest offset found for that length. The parse
+ *                stops past OPT_SPAN positions at one which no token jumps
+ *                over, whose cheapest parse is then the start of all the
+ *                cheapest ones after it, or at 2 * OPT_SPAN, or before a
+ *                match of OPT_NICE chars, taken as it is. Its tokens go in
+ *                'parsed'.
+ * Parameters   : e - encoder, with no parsed tokens left
+ *                all - parse all the data, even with a short lookahead
+ * Returned     : 1 if tokens were parsed, 0 if more input is needed
+ ***************************************************************************/
+static int parseOptimal(struct lz77_encoder *e, int all)
+{
+    /* variables */
+    struct optNode *n = e->nodes;
+    const unsigned char *w = e->window;
+    unsigned int m = e->wmask, b = e->base, avail = e->end - e->pos, p, price;
+    int tail = (e->format == LZ77_TRIPLES);     /* a token ends after its next char */
+    int i, j, k, l, len, off, last, reach = 0, nice = 0, coded;
+    const struct matches *found;
+    struct blockCodes c;
+    struct token t;
+    
+    /* the positions looked up need a full lookahead, but at the end */
+    if (!all && avail < 2 * OPT_SPAN + (unsigned int)e->LA_SIZE)
+        return 0;
+    /* the codes follow the tokens of the block so far */
+    if ((e->flags & STREAM_HUFFMAN) && e->ntok >= OPT_PRICED){
+        blockBits(e, e->ntok, &c, &coded);
+        blockPrices(e, &c, coded);
+    }
+    last = (avail < 2 * OPT_SPAN) ? (int)avail : 2 * OPT_SPAN;
+    
+    n[0].price = 0;
+    for (i = 0; i < last && (i < OPT_SPAN || i < reach); i++){
+        p = e->pos + i;
+        scanTo(e, p);
+        len = e->mlen[p & e->mmask];
+        off = e->moff[p & e->mmask];
+        if (i == reach)
+            n[++reach].price = UINT_MAX;
+        price = n[i].price + tokenPrice(e, 0, 0, w[(p - b) & m]);
+        if (price <= n[i + 1].price){
+            n[i + 1].price = price;
+            n[i + 1].len = 0;
+        }
+        if (len < (tail ? 1 : e->minMatch))
+            continue;
+        for (; reach < i + len + tail; reach++)
+            n[reach + 1].price = UINT_MAX;
+        if (len >= OPT_NICE){
+            j = i + len + tail;
+            n[j].len = len;
+            n[j].off = off;
+            nice = j;
+            break;
+        }
+        found = &(e->matches[p & e->mmask]);
+        for (k = 0, l = tail ? 1 : e->minMatch; l <= len; l++){
+            /* the matches are in order of length, the last is the longest */
+            while (found->m[k].len < l)
+                k++;
+            off = found->m[k].off;
+            price = n[i].price + tokenPrice(e, l, off, tail ? w[(p + l - b) & m] : 0);
+            if (price <= n[i + l + tail].price){
+                n[i + l + tail].price = price;
+                n[i + l + tail].len = l;
+                n[i + l + tail].off = off;
+            }
+        }
+    }
+    
+    /* the tokens, from the last one back */
+    e->nparsed = e->nextParsed = 0;
+    for (j = nice ? nice : i; j > 0; j -= (tail || t.len == 0) ? t.len + 1 : t.len){
+        t.len = n[j].len;
+        t.off = (t.len > 0) ? n[j].off : 0;
+        p = e->pos + j - ((tail || t.len == 0) ? 1 : t.len);
+        t.next = (tail || t.len == 0) ? w[(p - b) & m] : 0;
+        e->parsed[e->nparsed++] = t;
+    }
+    for (l = 0, j = e->nparsed - 1; l < j; l++, j--){
+        t = e->parsed[l];
+        e->parsed[l] = e->parsed[j];
+        e->parsed[j] = t;
+    }
+    
+    /* stopped with tokens going past: only the ones starting in the first
+       OPT_SPAN positions are kept, the others parsed again with the next
+       positions */
+    if (!nice && i < reach){
+        for (l = 0, j = 0; j < OPT_SPAN; l++)
+            j += (tail || e->parsed[l].len == 0) ? e->parsed[l].len + 1 : e->parsed[l].len;
+        e->nparsed = l;
+    }
+    
+    return 1;
+}
+
+/***************************************************************************
+ *                     NEXT BITS AND NEXT REACH FUNCTIONS
+ * Name         : nextBits, nextReach - bits and # of chars of the flagged
+ *                token at a position already looked up: its match, or a
+ *                literal if the match is too short (nothing at the end)
+ * Parameters   : e - encoder
+ *                q - absolute position
+ * Returned     : # of bits, # of chars
+ ***************************************************************************/
+static inline int nextBits(const struct lz77_encoder *e, unsigned int q)
+{
+    if (q == e->end)
+        return 0;
+    return (e->mlen[q & e->mmask] >= e->minMatch) ? 1 + e->offBits + e->lenBits : 9;
+}
+
+static inline int nextReach(const struct lz77_encoder *e, unsigned int q)
+{
+    if (q == e->end)
+        return 0;
+    return (e->mlen[q & e->mmask] >= e->minMatch) ? e->mlen[q & e->mmask] : 1;
+}
+
+/***************************************************************************
+ *                         ENCODER RUN FUNCTION
+ * Name         : encoderRun - make the tokens of the data in the window
+ * Parameters   : e - encoder
+ *                all - encode all the data, even with a short lookahead
+ * Returned     : 0 when done, 1 if the output must be pulled first
+ ***************************************************************************/
+static int encoderRun(struct lz77_encoder *e, int all)
+{
+    struct token t;
+    unsigned int avail, greedy, best, reach, q;
+    int i, k, n, saved, ksaved, la_size;
+    
+    while ((avail = e->end - e->pos) > 0 && (all || avail > 2 * (unsigned int)e->LA_SIZE)){
+        if (!tokenRoom(e))
+            return 1;
+        
+        /* the input of a segment is sampled at once, when there is enough
+           of it (or all of it), and stored after the block before it if it
+           won't compress */
+        if (!e->sampled){
+            if (avail < STORED_BLOCK && !all)
+                return 0;
+            if (!outputRoom(e, blockBound(e)))
+                return 1;
+            n = (avail < STORED_BLOCK) ? avail : STORED_BLOCK;
+            if (blockStored(e, n)){
+                if (e->ntok > 0)
+                    writeBlock(e);
+                sumWindow(e, e->pos, n);
+                putStored(e, n);
+                putSum(e);
+                skipBlock(e, n);
+                encoderNormalize(e);
+                continue;
+            }
+            e->sampled = 1;
+        }
+        
+        if (e->lazy == LAZY_OPTIMAL){
+            /* the tokens of the cheapest parse, one at a time */
+            if (e->nextParsed == e->nparsed && !parseOptimal(e, all))
+                return 0;
+            t = e->parsed[e->nextParsed++];
+            putToken(e, t);
+            e->pos += (e->format == LZ77_FLAGGED && t.len > 0) ? t.len : t.len + 1;
+            
+        }else if (e->lazy && e->format == LZ77_FLAGGED){
+            /* the match is cut to k chars (minMatch to 'lazy') if it and
+               the token after the cut save more bits over literals than
+               the whole match and the token after it, as the cut costs a
+               token more; otherwise a literal is sent instead of it if the
+               match after the literal reaches 2 chars farther, which pay
+               for the literal */
+            scanTo(e, e->pos);
+            t.len = e->mlen[e->pos & e->mmask];
+            t.off = e->moff[e->pos & e->mmask];
+            if (t.len >= e->minMatch){
+                scanTo(e, e->pos + t.len);
+                best = t.len;
+                saved = 9 * (t.len + nextReach(e, e->pos + t.len)) - nextBits(e, e->pos + t.len);
+                for (k = e->minMatch; k <= e->lazy && k < t.len; k++){
+                    q = e->pos + k;
+                    ksaved = 9 * (k + nextReach(e, q)) - nextBits(e, q);
+                    if (ksaved > saved){
+                        best = k;
+                        saved = ksaved;
+                    }
+                }
+                q = e->pos + 1;
+                if ((int)best == t.len && q != e->end && e->mlen[q & e->mmask] > t.len)
+                    best = 0;
+                t.len = best;
+            }
+            if (t.len < e->minMatch){
+                t.len = 0;
+                t.off = 0;
+            }
+            t.next = e->window[(e->pos - e->base) & e->wmask];
+            putToken(e, t);
+            e->pos += (t.len > 0) ? t.len : 1;
+            
+        }else if (e->lazy){
+            /* the greedy end of the token, and the match from there */
+            scanTo(e, e->pos);
+            greedy = e->pos + e->mlen[e->pos & e->mmask] + 1;
+            scanTo(e, greedy);
+            
+            best = greedy;
+            reach = (greedy == e->end) ? greedy : greedy + e->mlen[greedy & e->mmask];
+            for (k = 1, q = greedy - 1; k <= e->lazy && q > e->pos; k++, q--){
+                if (q + e->mlen[q & e->mmask] > reach){
+                    best = q;
+                    reach = q + e->mlen[q & e->mmask];
+                }
+            }
+            
+            /* a prefix of the match, up to the chosen end */
+            t.len = best - e->pos - 1;
+            t.off = (t.len > 0) ? e->moff[e->pos & e->mmask] : 0;
+            t.next = e->window[(best - 1 - e->base) & e->wmask];
+            putToken(e, t);
+            e->pos = best;
+            
+        }else{
+            /* find the longest match of the lookahead in the search buffer */
+            la_size = (avail > (unsigned int)e->LA_SIZE) ? e->LA_SIZE : (int)avail;
+            t = finderMatch(&e->f, e->pos, la_size, NULL);
+            if (e->format == LZ77_FLAGGED && t.len < e->minMatch){
+                t.len = 0;
+                t.off = 0;
+                t.next = e->window[(e->pos - e->base) & e->wmask];
+            }
+            putToken(e, t);
+            
+            /* move the matched positions in the search buffer; the fast
+               levels don't insert the ones deep in a long match */
+            n = (e->format == LZ77_FLAGGED && t.len > 0) ? t.len : t.len + 1;
+            for (i = 0; i < n; i++){
+                if (e->insert == 0 || i < e->insert)
+                    finderSlide(&e->f, e->sb_size == e->reach, e->pos, la_size, e->reach);
+                if (e->sb_size < e->reach)
+                    e->sb_size++;
+                e->pos++;
+                la_size = (e->end - e->pos > (unsigned int)e->LA_SIZE) ? e->LA_SIZE : (int)(e->end - e->pos);
+            }
+            e->scan = e->pos;
+        }
+        
+        encoderNormalize(e);
+    }
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                        ENCODER PUSH FUNCTION
+ * Name         : lz77_encoder_push - give input to the encoder
+ * Parameters   : e - encoder
+ *                src - the input
+ *                len - its size
+ * Returned     : # of bytes taken, less than 'len' when the output must be
+ *                pulled first; LZ77_ERROR after lz77_encoder_finish
+ ***************************************************************************/
+size_t lz77_encoder_push(struct lz77_encoder *e, const void *src, size_t len)
+{
+    struct source in = {NULL, src, len, 0};
+    int eof = 0;
+    STATS_LOCAL(prev);
+    
+    if (e->finished)
+        return LZ77_ERROR;
+    
+    e->started = 1;
+    STATS_ENTER(prev, PHASE_READ);
+    while (in.pos < in.size){
+        fillWindow(&in, e->window, e->wmask, e->LA_SIZE, encoderKeep(e), &e->end, &eof);
+        STATS_SWITCH(PHASE_MATCH);
+        if (encoderRun(e, 0))
+            break;
+        STATS_SWITCH(PHASE_READ);
+    }
+    STATS_SWITCH(prev);
+    
+    return in.pos;
+}
+
+/***************************************************************************
+ *                        ENCODER PULL FUNCTION
+ * Name         : lz77_encoder_pull - take compressed output of the encoder
+ * Parameters   : e - encoder
+ *                dst - where the output goes
+ *                cap - its size
+ * Returned     : # of bytes written in 'dst', 0 when there are none
+ ***************************************************************************/
+size_t lz77_encoder_pull(struct lz77_encoder *e, void *dst, size_t cap)
+{
+    size_t n = e->outEnd - e->outStart;
+    
+    if (n > cap)
+        n = cap;
+    memcpy(dst, &(e->out[e->outStart]), n);
+    if (n > 0)
+        e->started = 1;
+    e->outStart += n;
+    if (e->outStart == e->outEnd)
+        e->outStart = e->outEnd = 0;
+    
+    return n;
+}
+
+/***************************************************************************
+ *                        ENCODER FLUSH FUNCTION
+ * Name         : lz77_encoder_flush - encode all the input pushed so far.
+ *                The stream goes on: the last bits which are not a whole
+ *                byte yet stay in the encoder
+ * Parameters   : e - encoder
+ * Returned     : 0 when done, 1 if the output must be pulled and flush
+ *                called again
+ ***************************************************************************/
+int lz77_encoder_flush(struct lz77_encoder *e)
+{
+    e->started = 1;
+    if (encoderRun(e, 1))
+        return 1;
+    
+    /* the tokens so far make a block */
+    if (e->ntok > 0){
+        if (!outputRoom(e, blockBound(e)))
+            return 1;
+        writeBlock(e);
+    }
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                        ENCODER FINISH FUNCTION
+ * Name         : lz77_encoder_finish - encode all the input and end the
+ *                stream; nothing can be pushed afterwards
+ * Parameters   : e - encoder
+ * Returned     : 0 when done, 1 if the output must be pulled and finish
+ *                called again
+ ***************************************************************************/
+int lz77_encoder_finish(struct lz77_encoder *e)
+{
+    if (e->finished)
+        return 0;
+    if (lz77_encoder_flush(e))
+        return 1;
+    
+    /* the empty block which ends the stream, the checksum of the stream
+       and the padding of the last byte with zeros */
+    if (!outputRoom(e, BLOCK_COUNT_BITS / 8 + 2 + SUM_BITS / 8))
+        return 1;
+    putBits(e, 0, BLOCK_COUNT_BITS + 1);
+    if (e->flags & STREAM_CHECKSUM)
+        putBits(e, checksumDigest(&e->chain), SUM_BITS);
+    if (e->nbits > 0)
+        putBits(e, 0, 8 - e->nbits);
+    e->finished = 1;
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                         DRAIN ENCODER FUNCTION
+ * Name         : drainEncoder - move the output of the encoder in a bitFILE,
+ *                or in a memory area
+ * Parameters   : e - encoder
+ *                out - compressed stream
+ * Returned     : 0 on success, -1 if the memory area is too small
+ ***************************************************************************/
+static int drainEncoder(struct lz77_encoder *e, struct sink *out)
+{
+    const unsigned char *p = &(e->out[e->outStart]), *q = &(e->out[e->outEnd]);
+    
+    e->outStart = e->outEnd = 0;
+    if (out->bits == NULL)
+        return writeSink(out, p, q - p);
+    for (; q - p >= 4; p += 4)
+        bitIO_write_bits(out->bits, p[0] | (p[1] << 8) | (p[2] << 16) | ((uint64_t)p[3] << 24), 32);
+    for (; p < q; p++)
+        bitIO_write_bits(out->bits, *p, 8);
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                          REBASE VIEW FUNCTION
+ * Name         : rebaseView - move the start of a view up to a search
+ *                buffer before the oldest position still needed, so that
+ *                the positions index it from less than 4 GB away (the
+ *                probe table may still read a search buffer behind)
+ * Parameters   : e - encoder, encoding a view
+ ***************************************************************************/
+static void rebaseView(struct lz77_encoder *e)
+{
+    unsigned int n = encoderKeep(e) - e->base;
+    
+    if (n <= (unsigned int)e->reach)
+        return;
+    n -= e->reach;
+    e->window += n;
+    e->base += n;
+    e->f.window = e->window;
+    e->f.base = e->base;
+}
+
+/***************************************************************************
+ *                          ENCODE VIEW FUNCTION
+ * Name         : encodeView - compress data already in memory, a buffer or
+ *                a mapped file, without copying it in the ring buffer: the
+ *                window is the data itself, indexed by the positions from
+ *                the one of its first byte with no mask, and sliding it
+ *                costs nothing. The data is given
+ *                to the encoder VIEW_STEP bytes at a time, so that the
+ *                positions stay below NORMALIZE_POS whatever its size, and
+ *                the view is rebased before each step, so that they index
+ *                it past 4 GB.
+ * Parameters   : e - encoder, at the beginning of a stream
+ *                data - data to encode
+ *                size - its size
+ *                out - compressed stream
+ * Returned     : 0 on success, -1 if the memory output is too small
+ ***************************************************************************/
+static int encodeView(struct lz77_encoder *e, const unsigned char *data, uint64_t size, struct sink *out)
+{
+    unsigned int n;
+    int more;
+    
+    e->window = (unsigned char *)data;
+    e->wmask = ~0U;
+    e->base = e->end;
+    e->view = 1;
+    e->f.window = e->window;
+    e->f.wmask = e->wmask;
+    e->f.base = e->base;
+    
+    do{
+        rebaseView(e);
+        n = (size < VIEW_STEP) ? size : VIEW_STEP;
+        e->end += n;
+        size -= n;
+        do{
+            STATS_SWITCH(PHASE_MATCH);
+            more = encoderRun(e, size == 0);
+            STATS_SWITCH(PHASE_WRITE);
+            if (drainEncoder(e, out) < 0)
+                return -1;
+        }while (more);
+    }while (size > 0);
+    
+    /* the last block may read its input (to store it, or to hash it), which
+       must be written while the view is still there */
+    while (lz77_encoder_flush(e))
+        if (drainEncoder(e, out) < 0)
+            return -1;
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                           MAP SOURCE FUNCTION
+ * Name         : mapSource - map the rest of a regular file in memory, read
+ *                sequentially by the encoder
+ * Parameters   : src - input of the encoder
+ *                map - where the mapping goes
+ *                mapLen - where its size goes
+ *                off - where the offset of the rest of the file goes
+ * Returned     : 0 on success, -1 if the file can't be mapped (pipes,
+ *                special or empty files)
+ ***************************************************************************/
+static int mapSource(struct source *src, unsigned char **map, size_t *mapLen, off_t *off)
+{
+    struct stat st;
+    int fd = fileno(src->file);
+    
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (*off = ftello(src->file)) < 0 || *off >= st.st_size)
+        return -1;
+    if ((uint64_t)st.st_size != (size_t)st.st_size)
+        return -1;
+    *mapLen = st.st_size;
+    if ((*map = mmap(NULL, *mapLen, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+        return -1;
+    madvise(*map, *mapLen, MADV_SEQUENTIAL);
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                         ENCODE SOURCE FUNCTION
+ * Name         : encodeSource - compress the input of the encoder: memory
+ *                and regular files are encoded in place (see encodeView),
+ *                anything else, or anything after a dictionary, is read
+ *                straight in the ring buffer
+ * Parameters   : e - encoder, at the beginning of a stream
+ *                src - input to encode
+ *                out - compressed stream
+ * Returned     : 0 on success, -1 on reading errors or if the memory output
+ *                is too small
+ ***************************************************************************/
+static int encodeSource(struct lz77_encoder *e, struct source *src, struct sink *out)
+{
+    unsigned char *map;
+    size_t mapLen;
+    off_t off;
+    int eof = 0, more, view, ret = 0;
+    STATS_LOCAL(prev);
+    
+    e->started = 1;
+    STATS_ENTER(prev, PHASE_READ);
+    /* the dictionary is in the ring buffer, just before the data */
+    view = !(e->flags & STREAM_DICT);
+    if (view && src->file == NULL)
+        ret = encodeView(e, &(src->mem[src->pos]), src->size - src->pos, out);
+    else if (view && mapSource(src, &map, &mapLen, &off) == 0){
+        ret = encodeView(e, &(map[off]), mapLen - off, out);
+        munmap(map, mapLen);
+        fseeko(src->file, 0, SEEK_END);
+    }else{
+        do{
+            /* the ring slides by itself, nothing is moved */
+            STATS_SWITCH(PHASE_READ);
+            if (fillWindow(src, e->window, e->wmask, e->LA_SIZE, encoderKeep(e), &e->end, &eof) < 0){
+                printf("Error loading the data in the window.\n");
+                STATS_SWITCH(prev);
+                return -1;
+            }
+            do{
+                STATS_SWITCH(PHASE_MATCH);
+                more = encoderRun(e, eof);
+                STATS_SWITCH(PHASE_WRITE);
+                if ((ret = drainEncoder(e, out)) < 0)
+                    break;
+            }while (more);
+        }while (eof == 0 && ret == 0);
+    }
+    
+    STATS_SWITCH(PHASE_MATCH);
+    while (ret == 0 && lz77_encoder_finish(e))
+        ret = drainEncoder(e, out);
+    STATS_SWITCH(PHASE_WRITE);
+    if (ret == 0)
+        ret = drainEncoder(e, out);
+    STATS_SWITCH(prev);
+    
+    return ret;
+}
+
+/***************************************************************************
+ *                        LZ77 COMPRESS CTX FUNCTION
+ * Name         : lz77_compress_ctx - compress a memory area into another one
+ *                with an encoder, reset first if it was used: a stream of
+ *                its own, as lz77_compress_params, but nothing is allocated
+ * Parameters   : e - encoder
+ *                src - data to compress
+ *                srcLen - size of the data
+ *                dst - destination of the compressed stream
+ *                dstCap - size of the destination, see lz77_compress_bound
+ * Returned     : size of the compressed stream, LZ77_ERROR if it didn't fit
+ ***************************************************************************/
+size_t lz77_compress_ctx(struct lz77_encoder *e, const void *src, size_t srcLen, void *dst, size_t dstCap)
+{
+    struct source in = {NULL, src, srcLen, 0};
+    struct sink out = {NULL, dst, dstCap, 0, 0, NULL};
+    
+    if (e->started)
+        lz77_encoder_reset(e);
+    
+    return (encodeSource(e, &in, &out) < 0) ? LZ77_ERROR : out.pos;
+}
+
+/***************************************************************************
+ *                       LZ77 COMPRESS BATCH FUNCTION
+ * Name         : lz77_compress_batch - compress independent buffers, each
+ *                one in a stream of its own, with the same encoder
+ * Parameters   : e - encoder
+ *                b - the buffers, whose dstLen is set
+ *                n - their #
+ * Returned     : 0 on success, -1 if some of them didn't fit (their dstLen
+ *                is LZ77_ERROR)
+ ***************************************************************************/
+int lz77_compress_batch(struct lz77_encoder *e, struct lz77_batch *b, size_t n)
+{
+    size_t i;
+    int ret = 0;
+    
+    for (i = 0; i < n; i++)
+        if ((b[i].dstLen = lz77_compress_ctx(e, b[i].src, b[i].srcLen, b[i].dst, b[i].dstCap)) == LZ77_ERROR)
+            ret = -1;
+    
+    return ret;
+}
+
+/***************************************************************************
+ *                          STREAMING DECODER
+ * The decoder of decodeSink, fed by the caller: the pushed bytes go in a
+ * 64 bits accumulator and are decoded as soon as a token is complete. The
+ * output stays in a buffer of DECODE_BLOCK bytes plus the search buffer
+ * until it is pulled; decoding stops while the buffer is full. The header
+ * of a Huffman block is read a field at a time, as its tables don't fit in
+ * the accumulator. The bytes of a stored block are copied straight from
+ * the input, once the accumulator is empty.
+ ***************************************************************************/
+#define DECODER_HEADER 0        /* reading the stream header */
+#define DECODER_WIDE 1          /* reading the sizes of a wide header */
+#define DECODER_DICT 2          /* reading the dictionary ID */
+#define DECODER_BLOCK 3         /* reading a block header */
+#define DECODER_LENGTHS 4       /* reading the code lengths of a block */
+#define DECODER_TOKENS 5        /* reading tokens */
+#define DECODER_END 6           /* after the end of a stream of blocks */
+#define DECODER_STORED 7        /* copying the bytes of a stored block */
+#define DECODER_SUM 8           /* reading the checksum of a block */
+#define DECODER_FOOTER 9        /* reading the checksum of the stream */
+
+/* the state after a block */
+#define DECODER_NEXT(rd) (((rd)->flags & STREAM_CHECKSUM) ? DECODER_SUM : DECODER_BLOCK)
+
+struct lz77_decoder{
+    int LA_SIZE, SB_SIZE;
+    struct tokenReader rd;
+    int state;                  /* DECODER_* */
+    int nlen;                   /* # of code lengths read */
+    unsigned char len[256 + HUFF_MAX_SYMBOLS + MAX_OFF_SYMBOLS];
+    uint64_t acc;               /* bits not decoded yet */
+    int nbits;                  /* # of bits in the accumulator */
+    unsigned char *buffer;      /* output, after the search buffer */
+    size_t size, back;          /* its size and the # of bytes in it */
+    size_t cap;                 /* size allocated, kept from stream to stream */
+    size_t pulled;              /* bytes of the buffer already pulled */
+    size_t hashed;              /* bytes of the buffer already in the checksum */
+    const unsigned char *dict;  /* preset dictionary, NULL for none */
+    size_t dictLen;             /* its size */
+    int err;                    /* the stream is corrupted */
+    struct lz77_alloc allocator;    /* the caller's allocator */
+    const struct lz77_alloc *alloc; /* &allocator, NULL for malloc */
+};
+
+struct lz77_decoder *lz77_decoder_create(void)
+{
+    return lz77_decoder_create_alloc(NULL);
+}
+
+/***************************************************************************
+ *                     DECODER CREATE ALLOC FUNCTION
+ * Name         : lz77_decoder_create_alloc - create a streaming decoder
+ *                whose memory comes from an allocator
+ * Parameters   : a - the allocator, NULL for malloc
+ * Returned     : the decoder, NULL on errors
+ ***************************************************************************/
+struct lz77_decoder *lz77_decoder_create_alloc(const struct lz77_alloc *a)
+{
+    struct lz77_decoder *d;
+    
+    if ((d = memCalloc(a, sizeof(struct lz77_decoder))) == NULL)
+        return NULL;
+    if (a != NULL){
+        d->allocator = *a;
+        d->alloc = &d->allocator;
+    }
+    
+    return d;
+}
+
+/***************************************************************************
+ *                        DECODER DICT FUNCTION
+ * Name         : lz77_decoder_dict - give the decoder the preset dictionary
+ *                of the encoder, before any input. It is not copied: it
+ *                must stay there until the header of the stream is pushed.
+ *                A stream encoded without dictionary ignores it.
+ * Parameters   : d - decoder
+ *                dict - the dictionary
+ *                len - its size
+ * Returned     : 0 on success, -1 if input was already pushed
+ ***************************************************************************/
+int lz77_decoder_dict(struct lz77_decoder *d, const void *dict, size_t len)
+{
+    if (d->state != DECODER_HEADER || d->nbits > 0)
+        return -1;
+    d->dict = dict;
+    d->dictLen = len;
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                        DECODER RESET FUNCTION
+ * Name         : lz77_decoder_reset - drop the stream being decoded, for
+ *                another one. The dictionary stays, and so does the buffer,
+ *                allocated again only for larger sizes.
+ * Parameters   : d - decoder
+ ***************************************************************************/
+void lz77_decoder_reset(struct lz77_decoder *d)
+{
+    d->state = DECODER_HEADER;
+    d->acc = 0;
+    d->nbits = 0;
+    d->back = d->pulled = d->hashed = 0;
+    d->err = 0;
+}
+
+void lz77_decoder_destroy(struct lz77_decoder *d)
+{
+    if (d == NULL)
+        return;
+    memFree(d->alloc, d->buffer);
+    memFree(d->alloc, d);
+}
+
+/***************************************************************************
+ *                         DECODER ROOM FUNCTION
+ * Name         : decoderRoom - make room for 'n' bytes in the buffer, moving
+ *                the search buffer at the beginning once the rest is pulled
+ * Parameters   : d - decoder
+ *                n - # of bytes
+ * Returned     : 1 if there is room, 0 if the output must be pulled first
+ ***************************************************************************/
+static int decoderRoom(struct lz77_decoder *d, size_t n)
+{
+    size_t keep;
+    
+    if (d->back + n <= d->size)
+        return 1;
+    keep = (d->back < (size_t)d->SB_SIZE) ? d->back : (size_t)d->SB_SIZE;
+    if (d->pulled < d->back - keep)
+        return 0;
+    readerHash(&d->rd, &(d->buffer[d->hashed]), d->back - d->hashed);
+    d->hashed = keep;
+    memmove(d->buffer, &(d->buffer[d->back - keep]), keep);
+    d->pulled -= d->back - keep;
+    d->back = keep;
+    
+    return 1;
+}
+
+/***************************************************************************
+ *                        DECODER TOKENS FUNCTION
+ * Name         : decoderTokens - decode the complete tokens of the
+ *                accumulator, up to the end of the block
+ * Parameters   : d - decoder
+ * Returned     : 0 on success, -1 if the stream is corrupted
+ ***************************************************************************/
+static int decoderTokens(struct lz77_decoder *d)
+{
+    struct tokenReader *rd = &d->rd;
+    struct token t;
+    int bits, next;
+    
+    while (!rd->blocks || rd->left > 0){
+        /* a token may be cut at the end of the accumulator: it is decoded
+           again once complete */
+        bits = rd->coded ? huffToken(rd, d->acc, &t) : fixedToken(rd, d->acc, &t);
+        if (bits < 0 && d->nbits >= 57)
+            return -1;
+        if (bits < 0 || bits > d->nbits)
+            return 0;
+        
+        /* a match must point back inside the search buffer */
+        if (t.len >= d->LA_SIZE || (t.len > 0 && (t.off <= 0 || (size_t)t.off > d->back || t.off > d->SB_SIZE)))
+            return -1;
+        
+        if (!decoderRoom(d, t.len + 1))
+            return 0;
+        
+        d->acc >>= bits;
+        d->nbits -= bits;
+        rd->left--;
+        STATS_TOKEN(t.len, t.off);
+        
+        if (t.len > 0)
+            copyMatch(&(d->buffer[d->back]), t.off, t.len);
+        next = (rd->format == LZ77_TRIPLES || t.len == 0);
+        if (next)
+            d->buffer[d->back + t.len] = t.next;
+        d->back += t.len + next;
+    }
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                        DECODER STORED FUNCTION
+ * Name         : decoderStored - copy bytes of a stored block in the buffer
+ * Parameters   : d - decoder, with an empty accumulator
+ *                src - the input
+ *                len - its size
+ * Returned     : # of bytes taken, 0 if the output must be pulled first
+ ***************************************************************************/
+static size_t decoderStored(struct lz77_decoder *d, const unsigned char *src, size_t len)
+{
+    size_t n = ((size_t)d->rd.left < len) ? (size_t)d->rd.left : len;
+    
+    if (!decoderRoom(d, 1))
+        return 0;
+    if (n > d->size - d->back)
+        n = d->size - d->back;
+    memcpy(&(d->buffer[d->back]), src, n);
+    STATS_ADD(stored, n);
+    d->back += n;
+    if ((d->rd.left -= n) == 0)
+        d->state = DECODER_NEXT(&d->rd);
+    
+    return n;
+}
+
+/***************************************************************************
+ *                         DECODER RUN FUNCTION
+ * Name         : decoderRun - decode what the accumulator holds
+ * Parameters   : d - decoder
+ * Returned     : 0 on success, -1 if the stream is corrupted
+ ***************************************************************************/
+static int decoderRun(struct lz77_decoder *d)
+{
+    struct tokenReader *rd = &d->rd;
+    int ret;
+    
+    /* consume 'n' bits of the accumulator */
+#define SKIP(n) (d->acc >>= (n), d->nbits -= (n))
+    
+    while (1){
+        switch (d->state){
+            case DECODER_HEADER:
+                if (d->nbits < 2 * MAX_BIT_BUFFER)
+                    return 0;
+                if ((ret = readerInit(rd, d->acc)) < 0)
+                    return -1;
+                SKIP(2 * MAX_BIT_BUFFER);
+                if (ret > 0){
+                    d->state = DECODER_WIDE;
+                    break;
+                }
+                goto sizes;
+                
+            case DECODER_WIDE:
+                if (d->nbits < WIDE_SB_BITS + WIDE_LA_BITS)
+                    return 0;
+                if (readerWide(rd, d->acc & 0xFFFFFFFF, (d->acc >> WIDE_SB_BITS) & 0xFFFF) < 0)
+                    return -1;
+                SKIP(WIDE_SB_BITS + WIDE_LA_BITS);
+            sizes:
+                d->SB_SIZE = rd->sb_size;
+                d->LA_SIZE = rd->la_size;
+                d->size = d->SB_SIZE + d->LA_SIZE + DECODE_BLOCK;
+                if (d->size > d->cap){
+                    memFree(d->alloc, d->buffer);
+                    if ((d->buffer = memAlloc(d->alloc, d->size + COPY_SLACK)) == NULL){
+                        d->cap = 0;
+                        return -1;
+                    }
+                    d->cap = d->size;
+                }
+                if (rd->flags & STREAM_DICT){
+                    d->state = DECODER_DICT;
+                    break;
+                }
+                goto tokens;
+                
+            case DECODER_DICT:
+                if (d->nbits < DICT_ID_BITS)
+                    return 0;
+                if (d->dict == NULL || (d->acc & 0xFFFFFFFF) != lz77_dict_id(d->dict, d->dictLen))
+                    return -1;
+                SKIP(DICT_ID_BITS);
+                /* the end of the dictionary, already pulled */
+                d->back = d->pulled = d->hashed = (d->dictLen < (size_t)d->SB_SIZE) ? d->dictLen : (size_t)d->SB_SIZE;
+                memcpy(d->buffer, &(d->dict[d->dictLen - d->back]), d->back);
+            tokens:
+                d->state = rd->blocks ? DECODER_BLOCK : DECODER_TOKENS;
+                break;
+                
+            case DECODER_BLOCK:
+                if (d->nbits < BLOCK_COUNT_BITS)
+                    return 0;
+                rd->left = d->acc & ((1 << BLOCK_COUNT_BITS) - 1);
+                if (rd->left == 0 && !(rd->flags & STREAM_STORED)){
+                    SKIP(BLOCK_COUNT_BITS);
+                    d->state = DECODER_END;
+                    break;
+                }
+                if (d->nbits < BLOCK_COUNT_BITS + 1)
+                    return 0;
+                if (rd->left == 0){
+                    if (((d->acc >> BLOCK_COUNT_BITS) & 1) == 0){
+                        SKIP(BLOCK_COUNT_BITS + 1);
+                        d->state = (rd->flags & STREAM_CHECKSUM) ? DECODER_FOOTER : DECODER_END;
+                        break;
+                    }
+                    /* a stored block: its bytes start at the next byte */
+                    if (d->nbits < BLOCK_COUNT_BITS + 1 + STORED_LEN_BITS)
+                        return 0;
+                    rd->left = ((d->acc >> (BLOCK_COUNT_BITS + 1)) & (STORED_MAX - 1)) + 1;
+                    SKIP(BLOCK_COUNT_BITS + 1 + STORED_LEN_BITS);
+                    SKIP(d->nbits & 7);
+                    d->state = DECODER_STORED;
+                    break;
+                }
+                rd->coded = (d->acc >> BLOCK_COUNT_BITS) & 1;
+                if (rd->coded && !(rd->flags & STREAM_HUFFMAN))
+                    return -1;
+                SKIP(BLOCK_COUNT_BITS + 1);
+                d->nlen = 0;
+                d->state = rd->coded ? DECODER_LENGTHS : DECODER_TOKENS;
+                break;
+                
+            case DECODER_STORED:
+                /* the bytes already in the accumulator, the others are
+                   copied by lz77_decoder_push */
+                while (rd->left > 0 && d->nbits > 0){
+                    if (!decoderRoom(d, 1))
+                        return 0;
+                    d->buffer[d->back++] = (unsigned char)d->acc;
+                    SKIP(8);
+                    rd->left--;
+                    STATS_ADD(stored, 1);
+                }
+                if (rd->left > 0)
+                    return 0;
+                d->state = DECODER_NEXT(rd);
+                break;
+                
+            case DECODER_SUM:
+                /* all the bytes of the block are in the buffer */
+                if (d->nbits < SUM_BITS)
+                    return 0;
+                readerHash(rd, &(d->buffer[d->hashed]), d->back - d->hashed);
+                d->hashed = d->back;
+                if (readerCheck(rd, d->acc & 0xFFFFFFFF) < 0)
+                    return -1;
+                SKIP(SUM_BITS);
+                d->state = DECODER_BLOCK;
+                break;
+                
+            case DECODER_FOOTER:
+                if (d->nbits < SUM_BITS)
+                    return 0;
+                if (checksumDigest(&rd->chain) != (d->acc & 0xFFFFFFFF))
+                    return -1;
+                SKIP(SUM_BITS);
+                d->state = DECODER_END;
+                break;
+                
+            case DECODER_LENGTHS:
+                while (d->nlen < rd->nchars + rd->nlens + rd->offSyms){
+                    if (d->nbits < LENGTH_BITS)
+                        return 0;
+                    d->len[d->nlen++] = d->acc & ((1 << LENGTH_BITS) - 1);
+                    SKIP(LENGTH_BITS);
+                }
+                if (readerTables(rd, d->len) < 0)
+                    return -1;
+                d->state = DECODER_TOKENS;
+                break;
+                
+            case DECODER_END:
+                /* only the padding of the last byte may follow */
+                return (d->nbits >= 8) ? -1 : 0;
+                
+            case DECODER_TOKENS:
+                if (decoderTokens(d) < 0)
+                    return -1;
+                if (rd->blocks && rd->left == 0){
+                    d->state = DECODER_NEXT(rd);
+                    break;
+                }
+                return 0;
+        }
+    }
+#undef SKIP
+}
+
+/***************************************************************************
+ *                        DECODER PUSH FUNCTION
+ * Name         : lz77_decoder_push - give compressed input to the decoder
+ * Parameters   : d - decoder
+ *                src - the input
+ *                len - its size
+ * Returned     : # of bytes taken, less than 'len' when the output must be
+ *                pulled first; LZ77_ERROR if the stream is corrupted
+ ***************************************************************************/
+size_t lz77_decoder_push(struct lz77_decoder *d, const void *src, size_t len)
+{
+    const unsigned char *p = src;
+    size_t used = 0, n;
+    STATS_LOCAL(prev);
+    
+    if (d->err)
+        return LZ77_ERROR;
+    
+    STATS_ENTER(prev, PHASE_DECODE);
+    while (used < len){
+        if (d->state == DECODER_STORED && d->nbits == 0){
+            if ((n = decoderStored(d, &(p[used]), len - used)) == 0)
+                break;
+            used += n;
+            continue;
+        }
+        while (used < len && d->nbits <= 56){
+            d->acc |= (uint64_t)p[used++] << d->nbits;
+            d->nbits += 8;
+        }
+        if (decoderRun(d) < 0){
+            d->err = 1;
+            STATS_SWITCH(prev);
+            return LZ77_ERROR;
+        }
+        /* the accumulator is still full: the output is */
+        if (d->nbits > 56)
+            break;
+    }
+    STATS_SWITCH(prev);
+    
+    return used;
+}
+
+/***************************************************************************
+ *                        DECODER PULL FUNCTION
+ * Name         : lz77_decoder_pull - take decoded output of the decoder
+ * Parameters   : d - decoder
+ *                dst - where the output goes
+ *                cap - its size
+ * Returned     : # of bytes written in 'dst', 0 when there are none
+ ***************************************************************************/
+size_t lz77_decoder_pull(struct lz77_decoder *d, void *dst, size_t cap)
+{
+    size_t n = d->back - d->pulled;
+    
+    if (n > cap)
+        n = cap;
+    if (n > 0)
+        memcpy(dst, &(d->buffer[d->pulled]), n);
+    d->pulled += n;
+    
+    return n;
+}
+
+/***************************************************************************
+ *                        DECODER FINISH FUNCTION
+ * Name         : lz77_decoder_finish - tell the decoder the input is over
+ * Parameters   : d - decoder
+ * Returned     : 0 when all tokens are decoded (the output is still to be
+ *                pulled), 1 if the output must be pulled and finish called
+ *                again, -1 if the stream is corrupted or truncated
+ ***************************************************************************/
+int lz77_decoder_finish(struct lz77_decoder *d)
+{
+    struct token t;
+    int bits;
+    
+    if (d->err || decoderRun(d) < 0 || d->state == DECODER_HEADER || d->state == DECODER_WIDE || d->state == DECODER_DICT){
+        d->err = 1;
+        return -1;
+    }
+    
+    /* a stream of blocks ends with an empty block */
+    if (d->rd.blocks){
+        if (d->state == DECODER_END)
+            return 0;
+        /* the bytes of a stored block left in the accumulator wait for
+           the output to be pulled */
+        if (d->state == DECODER_STORED && d->nbits > 0)
+            return 1;
+        if (d->state != DECODER_TOKENS || (bits = d->rd.coded ? huffToken(&d->rd, d->acc, &t) : fixedToken(&d->rd, d->acc, &t)) < 0 || bits > d->nbits){
+            d->err = 1;
+            return -1;
+        }
+        return 1;
+    }
+    
+    /* what is left is the padding of the last byte, unless a whole token
+       waits for the output to be pulled */
+    return (fixedToken(&d->rd, d->acc, &t) <= d->nbits) ? 1 : 0;
+}
+
+/***************************************************************************
+ *                       LZ77 DECOMPRESS CTX FUNCTION
+ * Name         : lz77_decompress_ctx - decompress a memory area into another
+ *                one with a decoder, reset first, and its dictionary if it
+ *                has one: as lz77_decompress_dict, but nothing is allocated
+ *                once the decoder's buffer holds the stream's sizes
+ * Parameters   : d - decoder
+ *                src - compressed stream
+ *                srcLen - size of the compressed stream
+ *                dst - destination of the data
+ *                dstCap - size of the destination
+ * Returned     : size of the data, LZ77_ERROR if the stream is corrupted,
+ *                needs another dictionary or the data didn't fit
+ ***************************************************************************/
+size_t lz77_decompress_ctx(struct lz77_decoder *d, const void *src, size_t srcLen, void *dst, size_t dstCap)
+{
+    const unsigned char *in = src;
+    unsigned char *out = dst;
+    size_t used = 0, len = 0, n, m;
+    int more;
+    
+    lz77_decoder_reset(d);
+    while (used < srcLen){
+        if ((n = lz77_decoder_push(d, &(in[used]), srcLen - used)) == LZ77_ERROR)
+            return LZ77_ERROR;
+        used += n;
+        m = lz77_decoder_pull(d, &(out[len]), dstCap - len);
+        len += m;
+        /* the decoder waits for output which doesn't fit */
+        if (n == 0 && m == 0)
+            return LZ77_ERROR;
+    }
+    
+    do{
+        if ((more = lz77_decoder_finish(d)) < 0)
+            return LZ77_ERROR;
+        m = lz77_decoder_pull(d, &(out[len]), dstCap - len);
+        len += m;
+        if (more && m == 0)
+            return LZ77_ERROR;
+    }while (more);
+    
+    return (d->pulled == d->back) ? len : LZ77_ERROR;
+}
+
+/***************************************************************************
+ *                      LZ77 DECOMPRESS BATCH FUNCTION
+ * Name         : lz77_decompress_batch - decompress independent streams
+ *                with the same decoder
+ * Parameters   : d - decoder
+ *                b - the streams, whose dstLen is set
+ *                n - their #
+ * Returned     : 0 on success, -1 if some of them are corrupted or didn't
+ *                fit (their dstLen is LZ77_ERROR)
+ ***************************************************************************/
+int lz77_decompress_batch(struct lz77_decoder *d, struct lz77_batch *b, size_t n)
+{
+    size_t i;
+    int ret = 0;
+    
+    for (i = 0; i < n; i++)
+        if ((b[i].dstLen = lz77_decompress_ctx(d, b[i].src, b[i].srcLen, b[i].dst, b[i].dstCap)) == LZ77_ERROR)
+            ret = -1;
+    
+    return ret;
 }
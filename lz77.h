@@ -6,11 +6,102 @@
  *
  ***************************************************************************/
 
+#ifndef lz77_h
+#define lz77_h
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define LZ77_ERROR ((size_t)-1)     /* returned by the in-memory functions */
+
+#define LZ77_MAX_LA 65535               /* max lookahead size */
+#define LZ77_MAX_SB ((1 << 28) - 1)     /* max search buffer size */
+
+#define LZ77_TREE 0     /* binary search tree match finder */
+#define LZ77_HASH 1     /* hash chain match finder */
+#define LZ77_BT 2       /* binary tree match finder with bounded depth */
+
+#define LZ77_TRIPLES 0  /* token format: (offset, length, next char) */
+#define LZ77_FLAGGED 1  /* token format: a flag, then a char or (offset, length) */
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ * Memory of the encoders and decoders, for an arena or a pool: 'alloc'
+ * returns 'size' bytes (NULL if there are none), 'free' takes them back.
+ * Both get 'opaque'. All the memory is taken when an encoder (decoder) is
+ * created, or when its first stream tells the sizes, and given back when
+ * it is destroyed.
+ ***************************************************************************/
+struct lz77_alloc{
+    void *(*alloc)(void *opaque, size_t size);
+    void (*free)(void *opaque, void *ptr);
+    void *opaque;
+};
+
+/***************************************************************************
+ * Parameters of the encoder, set them to the defaults with lz77_defaults.
+ ***************************************************************************/
+struct lz77_params{
+    int la;         /* lookahead size (-1 for default) */
+    int sb;         /* search buffer size (-1 for default) */
+    int finder;     /* match finder: LZ77_TREE, LZ77_HASH or LZ77_BT */
+    int depth;      /* max hash chain (binary tree) depth (-1 for the level's) */
+    int level;      /* 1 (fastest) to 9 (smallest), -1 for default */
+    int huffman;    /* entropy code the tokens (0 or 1) */
+    int format;     /* token format: LZ77_TRIPLES or LZ77_FLAGGED */
+    const void *dict;   /* preset dictionary (NULL for none), see lz77_dict_id */
+    size_t dictLen;     /* its size */
+    int checksum;   /* checksums of the blocks and of the stream (0 or 1) */
+    const struct lz77_alloc *alloc; /* memory of the encoder (NULL for malloc) */
+};
+
+/* a buffer of a batch: compressed (decompressed) from src to dst, dstLen
+   being the size of the result or LZ77_ERROR */
+struct lz77_batch{
+    const void *src;
+    size_t srcLen;
+    void *dst;
+    size_t dstCap;
+    size_t dstLen;
+};
+
+/* streaming encoder and decoder, see lz77_encoder_create and
+   lz77_decoder_create */
+struct lz77_encoder;
+struct lz77_decoder;
+
 /***************************************************************************
  *                         FUNCTIONS DECLARATION
  ***************************************************************************/
-#ifndef lz77_h
-#define lz77_h
 void encode(FILE *file, struct bitFILE *out, int la, int sb);
-void decode(struct bitFILE *file, FILE *out);
+void lz77_defaults(struct lz77_params *p);
+int lz77_encode(FILE *file, struct bitFILE *out, const struct lz77_params *p);
+int decode(struct bitFILE *file, FILE *out);
+int lz77_decode(struct bitFILE *file, FILE *out, const void *dict, size_t dictLen);
+size_t lz77_compress(const void *src, size_t srcLen, void *dst, size_t dstCap, int la, int sb);
+size_t lz77_compress_params(const void *src, size_t srcLen, void *dst, size_t dstCap, const struct lz77_params *p);
+size_t lz77_decompress(const void *src, size_t srcLen, void *dst, size_t dstCap);
+size_t lz77_decompress_dict(const void *src, size_t srcLen, void *dst, size_t dstCap, const void *dict, size_t dictLen);
+size_t lz77_compress_bound(size_t srcLen, int la, int sb);
+unsigned int lz77_dict_id(const void *dict, size_t len);
+
+struct lz77_encoder *lz77_encoder_create(const struct lz77_params *p);
+size_t lz77_encoder_push(struct lz77_encoder *e, const void *src, size_t len);
+size_t lz77_encoder_pull(struct lz77_encoder *e, void *dst, size_t cap);
+int lz77_encoder_flush(struct lz77_encoder *e);
+int lz77_encoder_finish(struct lz77_encoder *e);
+void lz77_encoder_reset(struct lz77_encoder *e);
+void lz77_encoder_destroy(struct lz77_encoder *e);
+size_t lz77_compress_ctx(struct lz77_encoder *e, const void *src, size_t srcLen, void *dst, size_t dstCap);
+int lz77_compress_batch(struct lz77_encoder *e, struct lz77_batch *b, size_t n);
+
+struct lz77_decoder *lz77_decoder_create(void);
+struct lz77_decoder *lz77_decoder_create_alloc(const struct lz77_alloc *a);
+int lz77_decoder_dict(struct lz77_decoder *d, const void *dict, size_t len);
+size_t lz77_decoder_push(struct lz77_decoder *d, const void *src, size_t len);
+size_t lz77_decoder_pull(struct lz77_decoder *d, void *dst, size_t cap);
+int lz77_decoder_finish(struct lz77_decoder *d);
+void lz77_decoder_reset(struct lz77_decoder *d);
+void lz77_decoder_destroy(struct lz77_decoder *d);
+size_t lz77_decompress_ctx(struct lz77_decoder *d, const void *src, size_t srcLen, void *dst, size_t dstCap);
+int lz77_decompress_batch(struct lz77_decoder *d, struct lz77_batch *b, size_t n);
 #endif
@@ -14,7 +14,7 @@
  *   sequences from former contents instead of the original data. All data 
  *   will be coded in the same form (called token): -Address to already 
  *   coded contents; -Sequence length; -First deviating symbol.
- *   The window is contained in a fixed size buffer.
+ *   The window is contained in a fixed size ring buffer.
  *   The match between SB and LA is made by a binary tree, implemented in an
  *   array.
  ***************************************************************************/
@@ -25,48 +25,273 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include "getopt.h"
 #include "bitio.h"
 #include "lz77.h"
+#include "frame.h"
+#include "train.h"
+#include "stats.h"
 
 /***************************************************************************
  *                                CONSTANTS
  ***************************************************************************/
 #define MIN_LA_SIZE 2       /* min lookahead size */
-#define MAX_LA_SIZE 255     /* max lookahead size */
-#define MIN_SB_SIZE 0       /* min search buffer size */
-#define MAX_SB_SIZE 65535   /* max search buffer size */
+#define MAX_LA_SIZE LZ77_MAX_LA     /* max lookahead size */
+#define MIN_SB_SIZE 2       /* min search buffer size */
+#define MAX_SB_SIZE LZ77_MAX_SB     /* max search buffer size */
+#define DEFAULT_SB_SIZE 4095        /* search buffer size without -s */
+#define MAX_HUFF_LA 255     /* max lookahead size with Huffman coding */
+#define MAX_HUFF_SB 65535   /* max search buffer size with Huffman coding */
+#define MIN_DEPTH 1         /* min binary tree (hash chain) depth */
+#define MAX_THREADS 256     /* max # of compression threads */
+#define STREAM_CHUNK 65536  /* bytes read (written) at once on pipes */
 
 /***************************************************************************
  *                            TYPE DEFINITIONS
  ***************************************************************************/
 typedef enum{
     ENCODE,
-    DECODE
+    DECODE,
+    TRAIN
 } MODES;
 
+/* long options without a short one */
+enum{
+    OPT_RANGE = 256,
+    OPT_STATS,
+    OPT_TRAIN,
+    OPT_DICT_SIZE
+};
+
+static const struct option longOptions[] = {
+    {"range", required_argument, NULL, OPT_RANGE},
+    {"stats", optional_argument, NULL, OPT_STATS},
+    {"train", no_argument, NULL, OPT_TRAIN},
+    {"dict-size", required_argument, NULL, OPT_DICT_SIZE},
+    {NULL, 0, NULL, 0}
+};
+
+/***************************************************************************
+ *                           OPEN FILE FUNCTION
+ * Name         : openFile - open a file, "-" being the standard stream
+ * Parameters   : name - file name
+ *                mode - as fopen
+ *                std - stdin or stdout
+ * Returned     : the file, NULL on errors
+ ***************************************************************************/
+static FILE *openFile(const char *name, const char *mode, FILE *std)
+{
+    return (strcmp(name, "-") == 0) ? std : fopen(name, mode);
+}
+
+/***************************************************************************
+ *                           LOAD FILE FUNCTION
+ * Name         : loadFile - read a whole file in memory
+ * Parameters   : name - file name
+ *                len - where its size goes
+ * Returned     : the content, to be freed; NULL on errors
+ ***************************************************************************/
+static unsigned char *loadFile(const char *name, size_t *len)
+{
+    FILE *file;
+    unsigned char *buf = NULL, *tmp;
+    size_t cap = 0, n;
+    
+    if ((file = fopen(name, "rb")) == NULL)
+        return NULL;
+    *len = 0;
+    do{
+        if (*len == cap){
+            cap = cap ? 2 * cap : STREAM_CHUNK;
+            if ((tmp = realloc(buf, cap)) == NULL){
+                free(buf);
+                fclose(file);
+                return NULL;
+            }
+            buf = tmp;
+        }
+        n = fread(&(buf[*len]), 1, cap - *len, file);
+        *len += n;
+    }while (n > 0);
+    if (ferror(file)){
+        free(buf);
+        buf = NULL;
+    }
+    fclose(file);
+    
+    return buf;
+}
+
+/***************************************************************************
+ *                           PARSE SIZE FUNCTION
+ * Name         : parseSize - read a size, optionally in KiB (K) or MiB (M)
+ * Parameters   : arg - the option's argument
+ * Returned     : the size, -1 if it is not a valid size
+ ***************************************************************************/
+static long parseSize(const char *arg)
+{
+    char *end;
+    long n = strtol(arg, &end, 10);
+    
+    if (end == arg || n < 0)
+        return -1;
+    if (*end == 'K' || *end == 'k'){
+        n <<= 10;
+        end++;
+    }else if (*end == 'M' || *end == 'm'){
+        n <<= 20;
+        end++;
+    }
+    
+    return (*end == '\0' && n <= 0x7FFFFFFF) ? n : -1;
+}
+
+/***************************************************************************
+ *                         STREAM ENCODE FUNCTION
+ * Name         : streamEncode - compress a file through the streaming
+ *                encoder, for pipes
+ * Parameters   : in - file to encode
+ *                out - compressed file
+ *                p - encoder parameters
+ * Returned     : 0 on success, -1 on errors
+ ***************************************************************************/
+static int streamEncode(FILE *in, FILE *out, const struct lz77_params *p)
+{
+    struct lz77_encoder *e;
+    unsigned char ibuf[STREAM_CHUNK], obuf[STREAM_CHUNK];
+    size_t n, used, m;
+    int ret = -1, more;
+    
+    if ((e = lz77_encoder_create(p)) == NULL)
+        return -1;
+    
+    while ((n = fread(ibuf, 1, STREAM_CHUNK, in)) > 0){
+        for (used = 0; used < n; ){
+            used += lz77_encoder_push(e, &(ibuf[used]), n - used);
+            while ((m = lz77_encoder_pull(e, obuf, STREAM_CHUNK)) > 0)
+                if (fwrite(obuf, 1, m, out) != m)
+                    goto end;
+        }
+    }
+    if (ferror(in))
+        goto end;
+    
+    do{
+        more = lz77_encoder_finish(e);
+        while ((m = lz77_encoder_pull(e, obuf, STREAM_CHUNK)) > 0)
+            if (fwrite(obuf, 1, m, out) != m)
+                goto end;
+    }while (more);
+    ret = 0;
+    
+end:
+    lz77_encoder_destroy(e);
+    return ret;
+}
+
+/***************************************************************************
+ *                         STREAM DECODE FUNCTION
+ * Name         : streamDecode - decompress a single stream through the
+ *                streaming decoder, for pipes
+ * Parameters   : in - compressed file
+ *                out - output file
+ *                head - bytes already read from 'in'
+ *                len - their #
+ *                p - encoder parameters, for the dictionary
+ * Returned     : 0 on success, -1 if the stream is corrupted or on errors
+ ***************************************************************************/
+static int streamDecode(FILE *in, FILE *out, const unsigned char *head, size_t len, const struct lz77_params *p)
+{
+    struct lz77_decoder *d;
+    unsigned char ibuf[STREAM_CHUNK], obuf[STREAM_CHUNK];
+    size_t n, used, m;
+    int ret = -1, more;
+    
+    if ((d = lz77_decoder_create()) == NULL)
+        return -1;
+    if (p->dict != NULL)
+        lz77_decoder_dict(d, p->dict, p->dictLen);
+    
+    memcpy(ibuf, head, len);
+    n = len;
+    do{
+        for (used = 0; used < n; ){
+            if ((m = lz77_decoder_push(d, &(ibuf[used]), n - used)) == LZ77_ERROR)
+                goto end;
+            used += m;
+            while ((m = lz77_decoder_pull(d, obuf, STREAM_CHUNK)) > 0)
+                if (fwrite(obuf, 1, m, out) != m)
+                    goto end;
+        }
+    }while ((n = fread(ibuf, 1, STREAM_CHUNK, in)) > 0);
+    if (ferror(in))
+        goto end;
+    
+    do{
+        if ((more = lz77_decoder_finish(d)) < 0)
+            goto end;
+        while ((m = lz77_decoder_pull(d, obuf, STREAM_CHUNK)) > 0)
+            if (fwrite(obuf, 1, m, out) != m)
+                goto end;
+    }while (more);
+    ret = 0;
+    
+end:
+    lz77_decoder_destroy(d);
+    return ret;
+}
+
 /***************************************************************************
  *                            USER INTERFACE
  * Syntax: ./lz77 <options>
  * Options: -c: compression mode
  *          -d: decompression mode
- *          -i <filename>: input file
- *          -o <filename>: output file
- *          -l <value> : lookahead size (default 15)
- *          -s <value> : search-buffer size (default 4095)
+ *          -i <filename>: input file, - for stdin
+ *          -o <filename>: output file, - for stdout
+ *          -l <value> : lookahead size (default 15, up to 65535)
+ *          -s <value> : search-buffer size (default 4095, 2 to 256M - 1)
+ *          -m <finder> : match finder, bt, tree or hash (default bt)
+ *          -n <value> : max binary tree (hash chain) depth (default: level's)
+ *          -1 .. -9 : compression level, fastest to smallest (default 5)
+ *          -e : Huffman code the tokens
+ *          -f <format> : token format, triples or flagged (default triples)
+ *          -C : checksums of the blocks and of the stream, checked by -d
+ *          -T <value> : compress (decompress) blocks with <value> threads
+ *          -D <filename> : preset dictionary, the same to decompress
+ *          --range <start>:<len> : decode only <len> bytes from <start>
+ *          --stats[=text|json] : print the statistics of the run on stderr
+ *                                (make STATS=1 only)
+ *          --train : train a dictionary (-o) on the files of a directory (-i)
+ *          --dict-size <value> : size of the dictionary trained (default -s)
  *          -h: help
  ***************************************************************************/
 int main(int argc, char *argv[])
 {
     /* variables */
-    int opt;
-    FILE *file = NULL;
+    int opt, threads = 0, framed, ret;
+    unsigned char head[FRAME_MAGIC_SIZE];
+    size_t headLen;
+    FILE *file = NULL, *fileOut = NULL;
     struct bitFILE *bitF = NULL;
     MODES mode = -1;
     char *filenameIn = NULL, *filenameOut = NULL;
-    int la_size = -1, sb_size = -1; /* default size */
+    struct lz77_params params;
+    int range = 0;
+    uint64_t rangeStart = 0, rangeLen = 0;
+    unsigned char *dict = NULL;
+    char *end;
+    long size, dictSize = -1;
+#ifdef LZ77_STATS
+    int stats = -1;             /* print them: 0 as text, 1 in JSON */
+    double start = statsNow();
+    
+    statsPhase(PHASE_OTHER);
+#endif
+    
+    lz77_defaults(&params);
     
-    while ((opt = getopt(argc, argv, "cdi:o:l:s:h")) != -1)
+    while ((opt = getopt_long(argc, argv, "cdi:o:l:s:m:n:T:D:ef:Ch123456789", longOptions, NULL)) != -1)
     {
         switch(opt)
         {
@@ -99,29 +324,150 @@ int main(int argc, char *argv[])
                 break;
                 
             case 'l':       /* lookahead size */
-                la_size = atoi(optarg);
-                if (la_size < MIN_LA_SIZE || la_size > MAX_LA_SIZE){
+                size = parseSize(optarg);
+                params.la = size;
+                if (size < MIN_LA_SIZE || size > MAX_LA_SIZE){
                     fprintf(stderr, "Bad lookahead size value.\n");
                     goto error;
                 }
                 break;
                 
             case 's':       /* search-buffer size */
-                sb_size = atoi(optarg);
-                if (sb_size < MIN_SB_SIZE || sb_size > MAX_SB_SIZE){
+                size = parseSize(optarg);
+                params.sb = size;
+                if (size < MIN_SB_SIZE || size > MAX_SB_SIZE){
                     fprintf(stderr, "Bad search-buffer size value.\n");
                     goto error;
                 }
                 break;
                 
+            case 'm':       /* match finder */
+                if (strcmp(optarg, "bt") == 0)
+                    params.finder = LZ77_BT;
+                else if (strcmp(optarg, "tree") == 0)
+                    params.finder = LZ77_TREE;
+                else if (strcmp(optarg, "hash") == 0)
+                    params.finder = LZ77_HASH;
+                else{
+                    fprintf(stderr, "Bad match finder.\n");
+                    goto error;
+                }
+                break;
+                
+            case 'n':       /* max binary tree (hash chain) depth */
+                params.depth = atoi(optarg);
+                if (params.depth < MIN_DEPTH){
+                    fprintf(stderr, "Bad depth value.\n");
+                    goto error;
+                }
+                break;
+                
+            case 'T':       /* block-parallel compression */
+                threads = atoi(optarg);
+                if (threads < 1 || threads > MAX_THREADS){
+                    fprintf(stderr, "Bad threads value.\n");
+                    goto error;
+                }
+                break;
+                
+            case 'D':       /* preset dictionary */
+                if (dict != NULL){
+                    fprintf(stderr, "Multiple dictionaries not allowed.\n");
+                    goto error;
+                }
+                if ((dict = loadFile(optarg, &params.dictLen)) == NULL){
+                    perror("Reading the dictionary");
+                    goto error;
+                }
+                params.dict = dict;
+                break;
+                
+            case OPT_RANGE: /* range of the data to decode */
+                rangeStart = strtoull(optarg, &end, 10);
+                if (end == optarg || *end != ':'){
+                    fprintf(stderr, "Bad range, <start>:<len> expected.\n");
+                    goto error;
+                }
+                rangeLen = strtoull(end + 1, &end, 10);
+                if (*end != '\0' || rangeLen > SIZE_MAX){
+                    fprintf(stderr, "Bad range, <start>:<len> expected.\n");
+                    goto error;
+                }
+                range = 1;
+                break;
+                
+            case OPT_TRAIN: /* dictionary training */
+                mode = TRAIN;
+                break;
+                
+            case OPT_DICT_SIZE: /* size of the dictionary trained */
+                dictSize = parseSize(optarg);
+                if (dictSize < 1){
+                    fprintf(stderr, "Bad dictionary size value.\n");
+                    goto error;
+                }
+                break;
+                
+            case OPT_STATS: /* statistics of the hot paths */
+#ifdef LZ77_STATS
+                if (optarg == NULL || strcmp(optarg, "text") == 0)
+                    stats = 0;
+                else if (strcmp(optarg, "json") == 0)
+                    stats = 1;
+                else{
+                    fprintf(stderr, "Bad statistics format, text or json expected.\n");
+                    goto error;
+                }
+                break;
+#else
+                fprintf(stderr, "Statistics are not compiled in, build with make STATS=1.\n");
+                goto error;
+#endif
+                
+            case '1': case '2': case '3': case '4': case '5':
+            case '6': case '7': case '8': case '9':
+                params.level = opt - '0';   /* compression level */
+                break;
+                
+            case 'e':       /* entropy coding of the tokens */
+                params.huffman = 1;
+                break;
+                
+            case 'f':       /* token format */
+                if (strcmp(optarg, "triples") == 0)
+                    params.format = LZ77_TRIPLES;
+                else if (strcmp(optarg, "flagged") == 0)
+                    params.format = LZ77_FLAGGED;
+                else{
+                    fprintf(stderr, "Bad token format.\n");
+                    goto error;
+                }
+                break;
+                
+            case 'C':       /* checksums */
+                params.checksum = 1;
+                break;
+                
             case 'h':       /* help */
                 printf("Usage: lz77 <options>\n");
                 printf("  -c : Encode input file to output file.\n");
                 printf("  -d : Decode input file to output file.\n");
-                printf("  -i <filename> : Name of input file.\n");
-                printf("  -o <filename> : Name of output file.\n");
-                printf("  -l <value> : Lookahead size (default 15)\n");
-                printf("  -s <value> : Search-buffer size (default 4095)\n");
+                printf("  -i <filename> : Name of input file, - for stdin.\n");
+                printf("  -o <filename> : Name of output file, - for stdout.\n");
+                printf("  -l <value> : Lookahead size (default 15, up to 65535)\n");
+                printf("  -s <value> : Search-buffer size (default 4095, 2 to 256M - 1), K and M suffixes allowed\n");
+                printf("  -m <finder> : Match finder, bt, tree or hash (default bt)\n");
+                printf("  -n <value> : Max binary tree (hash chain) depth (default: level's)\n");
+                printf("  -1 .. -9 : Compression level, fastest to smallest (default 5)\n");
+                printf("  -e : Huffman code the tokens\n");
+                printf("  -f <format> : Token format, triples or flagged (default triples)\n");
+                printf("  -C : Checksums of the blocks and of the stream, checked by -d\n");
+                printf("  -T <value> : Compress (decompress) blocks with <value> threads\n");
+                printf("  -D <filename> : Preset dictionary, the same to decompress\n");
+                printf("  --range <start>:<len> : Decode only <len> bytes from <start> (framed files)\n");
+                printf("  --stats[=text|json] : Print the statistics of the run on stderr (make STATS=1)\n");
+                printf("  --train : Train a dictionary (-o) on the files of a directory (-i), for -s -l -m -1..-9 -e -f\n");
+                printf("  --dict-size <value> : Size of the dictionary trained (default: search-buffer size)\n");
                 printf("  -h : Command line options.\n\n");
                 break;
                 
@@ -137,43 +483,147 @@ int main(int argc, char *argv[])
         fprintf(stderr, "Output file must be provided\n");
         goto error;
     }
+    if (params.huffman && (params.la > MAX_HUFF_LA || params.sb > MAX_HUFF_SB)){
+        fprintf(stderr, "Huffman coding needs a lookahead up to %d and a search-buffer up to %d.\n", MAX_HUFF_LA, MAX_HUFF_SB);
+        goto error;
+    }
+    if (dict != NULL && (threads > 0 || range)){
+        fprintf(stderr, "Dictionaries can't be used with framed files (-T).\n");
+        goto error;
+    }
     
-    if (mode == ENCODE){
-        if ((file = fopen(filenameIn, "rb")) == NULL){
-            perror("Opening input file");
+    if (mode == TRAIN){
+        /* the encoder keeps the last search-buffer size bytes at most */
+        if (params.sb < 0)
+            params.sb = DEFAULT_SB_SIZE;
+        if (dictSize < 0)
+            dictSize = params.sb;
+        if (dict != NULL || dictSize > params.sb){
+            fprintf(stderr, "The dictionary must fit in the search-buffer, without -D.\n");
             goto error;
         }
-        if ((bitF = bitIO_open(filenameOut, BIT_IO_W)) == NULL) {
+        if ((dict = malloc(dictSize)) == NULL){
+            perror("Training");
+            goto error;
+        }
+        if ((params.dictLen = trainDict(filenameIn, dict, dictSize, &params, threads, stderr)) == LZ77_ERROR){
+            fprintf(stderr, "No samples to train on, or reading errors.\n");
+            goto error;
+        }
+        if ((fileOut = openFile(filenameOut, "wb", stdout)) == NULL){
             perror("Opening output file");
             goto error;
         }
-        encode(file, bitF, la_size, sb_size);
+        if (fwrite(dict, 1, params.dictLen, fileOut) != params.dictLen){
+            perror("Writing output file");
+            goto error;
+        }
+        
+    }else if (mode == ENCODE){
+        if ((file = openFile(filenameIn, "rb", stdin)) == NULL){
+            perror("Opening input file");
+            goto error;
+        }
+        if (threads > 0 || strcmp(filenameOut, "-") == 0 || file == stdin){
+            if ((fileOut = openFile(filenameOut, "wb", stdout)) == NULL){
+                perror("Opening output file");
+                goto error;
+            }
+            if (threads > 0)
+                ret = frameEncode(file, fileOut, &params, threads);
+            else
+                ret = streamEncode(file, fileOut, &params);
+            if (ret < 0){
+                perror("Compressing");
+                goto error;
+            }
+        }else{
+            if ((bitF = bitIO_open(filenameOut, BIT_IO_W)) == NULL) {
+                perror("Opening output file");
+                goto error;
+            }
+            if (lz77_encode(file, bitF, &params) < 0)
+                goto error;
+        }
             
     }else if (mode == DECODE){
-        if ((bitF = bitIO_open(filenameIn, BIT_IO_R)) == NULL) {
+        /* framed files start with a magic, single streams with the header */
+        if ((file = openFile(filenameIn, "rb", stdin)) == NULL){
             perror("Opening input file");
             goto error;
         }
-        if ((file = fopen(filenameOut, "w")) == NULL){
+        headLen = fread(head, 1, FRAME_MAGIC_SIZE, file);
+        if (ferror(file)){
+            perror("Reading input file");
+            goto error;
+        }
+        framed = frameProbe(head, headLen);
+        /* before the output file is created (and an existing one emptied) */
+        if (range && !framed){
+            fprintf(stderr, "Ranges can only be decoded from framed files (-T)\n");
+            goto error;
+        }
+        if ((fileOut = openFile(filenameOut, "wb", stdout)) == NULL){
             perror("Opening output file");
             goto error;
         }
-        decode(bitF, file);
+        if (range){
+            if (frameDecodeRange(file, fileOut, rangeStart, rangeLen) == LZ77_ERROR){
+                fprintf(stderr, "Corrupted input file\n");
+                goto error;
+            }
+        }else if (framed){
+            if (frameDecode(file, fileOut, threads) < 0){
+                fprintf(stderr, "Corrupted input file\n");
+                goto error;
+            }
+        }else if (file == stdin){
+            if (streamDecode(file, fileOut, head, headLen, &params) < 0){
+                fprintf(stderr, "Corrupted input file\n");
+                goto error;
+            }
+        }else{
+            fclose(file);
+            file = NULL;
+            if ((bitF = bitIO_open(filenameIn, BIT_IO_R)) == NULL) {
+                perror("Opening input file");
+                goto error;
+            }
+            if (lz77_decode(bitF, fileOut, params.dict, params.dictLen) < 0){
+                fprintf(stderr, "Corrupted input file\n");
+                goto error;
+            }
+        }
             
     }else{
-        fprintf(stderr, "Select ENCODE or DECODE mode\n");
+        fprintf(stderr, "Select ENCODE, DECODE or TRAIN mode\n");
         goto error;
     }
     
-    fclose(file);
-    bitIO_close(bitF);
+    if (file != NULL && file != stdin)
+        fclose(file);
+    if (fileOut != NULL && (fileOut == stdout ? fflush(fileOut) : fclose(fileOut)) != 0){
+        perror("Writing output file");
+        exit (EXIT_FAILURE);
+    }
+    if (bitF != NULL)
+        bitIO_close(bitF);
+#ifdef LZ77_STATS
+    if (stats >= 0){
+        statsMerge();
+        statsPrint(stderr, stats, statsNow() - start);
+    }
+#endif
     return 0;
     
     /* handle error */
 error:
-    if (file != NULL){
+    if (file != NULL && file != stdin){
         fclose(file);
     }
+    if (fileOut != NULL && fileOut != stdout){
+        fclose(fileOut);
+    }
     if (bitF != NULL){
         bitIO_close(bitF);
     }
@@ -0,0 +1,233 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : stats.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ *   Statistics of the hot paths, compiled in with -DLZ77_STATS only. Each
+ *   thread counts in its own lz77Stats, without locking, and adds it to the
+ *   total with statsMerge once done; the time of the phases is summed over
+ *   the threads as well.
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+
+#ifdef LZ77_STATS
+/***************************************************************************
+ *                               VARIABLES
+ ***************************************************************************/
+__thread struct lz77_stats lz77Stats;
+
+static __thread int current = PHASE_OTHER;  /* phase of the thread */
+static __thread uint64_t since;             /* when it started, 0 if never */
+
+static struct lz77_stats total;
+static pthread_mutex_t totalLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *phaseNames[PHASES] = {"other", "read", "match", "huffman", "write", "decode"};
+
+/***************************************************************************
+ *                             NOW FUNCTIONS
+ * Name         : statsNow, nanoNow - monotonic time
+ * Returned     : seconds (nanoseconds)
+ ***************************************************************************/
+static uint64_t nanoNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+double statsNow(void)
+{
+    return nanoNow() * 1e-9;
+}
+
+/***************************************************************************
+ *                           BUCKET FUNCTION
+ * Name         : bucket - histogram bucket of a value, its bit length
+ * Parameters   : v - the value
+ * Returned     : the bucket
+ ***************************************************************************/
+static int bucket(unsigned int v)
+{
+    int b = v ? 32 - __builtin_clz(v) : 0;
+
+    return (b < STATS_BUCKETS) ? b : STATS_BUCKETS - 1;
+}
+
+/***************************************************************************
+ *                          STATS DEPTH FUNCTION
+ * Name         : statsDepth - count the nodes visited by a find (insert)
+ * Parameters   : d - counters of the finds (inserts)
+ *                n - # of nodes visited
+ ***************************************************************************/
+void statsDepth(struct statsDepth *d, int n)
+{
+    d->calls++;
+    d->nodes += n;
+    if ((uint64_t)n > d->max)
+        d->max = n;
+}
+
+/***************************************************************************
+ *                          STATS TOKEN FUNCTION
+ * Name         : statsToken - count a token
+ * Parameters   : len - length of its match, 0 for none
+ *                off - offset of its match
+ ***************************************************************************/
+void statsToken(int len, int off)
+{
+    lz77Stats.tokens++;
+    if (len == 0){
+        lz77Stats.literals++;
+        return;
+    }
+    lz77Stats.lens[bucket(len)]++;
+    lz77Stats.offs[bucket(off)]++;
+}
+
+/***************************************************************************
+ *                          STATS PHASE FUNCTION
+ * Name         : statsPhase - switch the thread to another phase, the time
+ *                since the last switch goes to the one it leaves
+ * Parameters   : p - the new phase
+ * Returned     : the phase left, to switch back to it
+ ***************************************************************************/
+int statsPhase(int p)
+{
+    uint64_t now = nanoNow();
+    int prev = current;
+
+    if (since != 0)
+        lz77Stats.phase[current] += now - since;
+    since = now;
+    current = p;
+
+    return prev;
+}
+
+/***************************************************************************
+ *                          STATS MERGE FUNCTION
+ * Name         : statsMerge - add the counters of the thread to the total,
+ *                and reset them
+ ***************************************************************************/
+void statsMerge(void)
+{
+    uint64_t *dst = (uint64_t *)&total, *src = (uint64_t *)&lz77Stats;
+    uint64_t findMax, insertMax;
+    size_t i;
+
+    statsPhase(current);
+    pthread_mutex_lock(&totalLock);
+    /* the max depths don't add up */
+    findMax = (lz77Stats.find.max > total.find.max) ? lz77Stats.find.max : total.find.max;
+    insertMax = (lz77Stats.insert.max > total.insert.max) ? lz77Stats.insert.max : total.insert.max;
+    for (i = 0; i < sizeof(total) / sizeof(uint64_t); i++)
+        dst[i] += src[i];
+    total.find.max = findMax;
+    total.insert.max = insertMax;
+    pthread_mutex_unlock(&totalLock);
+    memset(&lz77Stats, 0, sizeof(lz77Stats));
+}
+
+/***************************************************************************
+ *                          PRINT HISTOGRAM FUNCTION
+ * Name         : printHistogram - print the buckets up to the last used
+ * Parameters   : out - output file
+ *                name - name of the histogram
+ *                h - the buckets
+ *                json - as a JSON array of the buckets, or a line each
+ ***************************************************************************/
+static void printHistogram(FILE *out, const char *name, const uint64_t *h, int json)
+{
+    int b, last = 0;
+
+    for (b = 0; b < STATS_BUCKETS; b++)
+        if (h[b] != 0)
+            last = b;
+
+    if (json){
+        fprintf(out, "  \"%s\": [", name);
+        for (b = 0; b <= last; b++)
+            fprintf(out, "%s%llu", b ? ", " : "", (unsigned long long)h[b]);
+        fprintf(out, "],\n");
+        return;
+    }
+
+    fprintf(out, "%s:\n", name);
+    for (b = 1; b <= last; b++){
+        if (b == 1)
+            fprintf(out, "  %10s %12llu\n", "1", (unsigned long long)h[b]);
+        else
+            fprintf(out, "  %5u-%-5u %12llu\n", 1U << (b - 1), (1U << b) - 1, (unsigned long long)h[b]);
+    }
+}
+
+/***************************************************************************
+ *                          STATS PRINT FUNCTION
+ * Name         : statsPrint - print the total of the merged counters
+ * Parameters   : out - output file
+ *                json - in JSON, or as text
+ *                wall - wall time of the whole run, in seconds
+ ***************************************************************************/
+void statsPrint(FILE *out, int json, double wall)
+{
+    const struct lz77_stats *s = &total;
+    const struct statsDepth *d[2] = {&s->find, &s->insert};
+    const char *dname[2] = {"find", "insert"};
+    unsigned long long v[7];
+    int i;
+
+    if (json){
+        fprintf(out, "{\n  \"tokens\": %llu,\n  \"literals\": %llu,\n", (unsigned long long)s->tokens, (unsigned long long)s->literals);
+        printHistogram(out, "match_lengths", s->lens, 1);
+        printHistogram(out, "offsets", s->offs, 1);
+        for (i = 0; i < 2; i++)
+            fprintf(out, "  \"%s\": {\"calls\": %llu, \"nodes\": %llu, \"max_depth\": %llu},\n", dname[i],
+                    (unsigned long long)d[i]->calls, (unsigned long long)d[i]->nodes, (unsigned long long)d[i]->max);
+    }else{
+        fprintf(out, "tokens: %llu, literal-only: %llu\n", (unsigned long long)s->tokens, (unsigned long long)s->literals);
+        printHistogram(out, "match lengths", s->lens, 0);
+        printHistogram(out, "offsets", s->offs, 0);
+        for (i = 0; i < 2; i++)
+            fprintf(out, "%s: %llu calls, %llu nodes visited (%.2f per call, max %llu)\n", dname[i],
+                    (unsigned long long)d[i]->calls, (unsigned long long)d[i]->nodes,
+                    d[i]->calls ? (double)d[i]->nodes / d[i]->calls : 0.0, (unsigned long long)d[i]->max);
+    }
+
+    v[0] = s->cmpBytes;
+    v[1] = s->deletes;
+    v[2] = s->deletes2;
+    v[3] = s->slides;
+    v[4] = s->refills;
+    v[5] = s->normalizes;
+    v[6] = s->stored;
+    if (json){
+        fprintf(out, "  \"compared_bytes\": %llu,\n  \"deletes\": %llu,\n  \"deletes_two_children\": %llu,\n"
+                "  \"slides\": %llu,\n  \"refills\": %llu,\n  \"normalizations\": %llu,\n  \"stored_bytes\": %llu,\n"
+                "  \"time_ms\": {", v[0], v[1], v[2], v[3], v[4], v[5], v[6]);
+        for (i = 0; i < PHASES; i++)
+            fprintf(out, "%s\"%s\": %.3f", i ? ", " : "", phaseNames[i], s->phase[i] * 1e-6);
+        fprintf(out, "},\n  \"wall_ms\": %.3f\n}\n", wall * 1e3);
+        return;
+    }
+
+    fprintf(out, "bytes compared: %llu\n", v[0]);
+    fprintf(out, "deletes: %llu, with two children: %llu\n", v[1], v[2]);
+    fprintf(out, "window: %llu positions slid, %llu refills, %llu normalizations\n", v[3], v[4], v[5]);
+    fprintf(out, "stored: %llu bytes\n", v[6]);
+    fprintf(out, "time (ms):");
+    for (i = 0; i < PHASES; i++)
+        fprintf(out, " %s %.3f", phaseNames[i], s->phase[i] * 1e-6);
+    fprintf(out, ", wall %.3f\n", wall * 1e3);
+}
+#endif
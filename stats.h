@@ -0,0 +1,92 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : stats.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef stats_h
+#define stats_h
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define STATS_BUCKETS 32        /* histogram buckets, one per bit length */
+
+#define PHASE_OTHER 0           /* wall time phases, see statsPhase */
+#define PHASE_READ 1            /* reading the input in the window */
+#define PHASE_MATCH 2           /* match finding and parsing */
+#define PHASE_HUFFMAN 3         /* building and writing Huffman blocks */
+#define PHASE_WRITE 4           /* writing the output */
+#define PHASE_DECODE 5          /* decoding the tokens */
+#define PHASES 6
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ * Counters of the hot paths, kept per thread and summed by statsMerge. The
+ * histograms have a bucket per bit length: bucket b counts the values in
+ * [2^(b-1), 2^b), bucket 0 the zeros.
+ ***************************************************************************/
+struct statsDepth{
+    uint64_t calls;             /* # of finds (inserts) */
+    uint64_t nodes;             /* nodes (chain positions) visited */
+    uint64_t max;               /* most nodes visited by a call */
+};
+
+struct lz77_stats{
+    uint64_t tokens;            /* tokens made (or decoded) */
+    uint64_t literals;          /* tokens without match */
+    uint64_t lens[STATS_BUCKETS];   /* match lengths */
+    uint64_t offs[STATS_BUCKETS];   /* match offsets */
+    struct statsDepth find, insert; /* work of the match finder */
+    uint64_t cmpBytes;          /* bytes compared by the match loops */
+    uint64_t deletes;           /* nodes deleted from the tree */
+    uint64_t deletes2;          /* ... which had both the children */
+    uint64_t slides;            /* positions moved in the search buffer */
+    uint64_t refills;           /* reads of input in the window */
+    uint64_t normalizes;        /* positions brought back by the encoder */
+    uint64_t stored;            /* bytes of the stored blocks */
+    uint64_t phase[PHASES];     /* wall time of each phase, in ns */
+};
+
+/***************************************************************************
+ * The counters are compiled in with -DLZ77_STATS (make STATS=1), otherwise
+ * the macros are empty and the hot paths are untouched. STATS_LOCAL
+ * declares a per call counter, as the depth of a walk. STATS_ENTER
+ * switches to a phase and keeps the one left, to STATS_SWITCH back to it;
+ * a thread adds its counters to the total with STATS_MERGE once done.
+ ***************************************************************************/
+#ifdef LZ77_STATS
+extern __thread struct lz77_stats lz77Stats;
+
+#define STATS_ADD(field, n) (lz77Stats.field += (n))
+#define STATS_LOCAL(n) int n = 0
+#define STATS_INC(n) ((n)++)
+#define STATS_DEPTH(field, n) statsDepth(&lz77Stats.field, (n))
+#define STATS_TOKEN(len, off) statsToken((len), (off))
+#define STATS_ENTER(prev, p) ((prev) = statsPhase(p))
+#define STATS_SWITCH(p) statsPhase(p)
+#define STATS_MERGE() statsMerge()
+
+void statsDepth(struct statsDepth *d, int n);
+void statsToken(int len, int off);
+int statsPhase(int p);
+void statsMerge(void);
+void statsPrint(FILE *out, int json, double wall);
+double statsNow(void);
+#else
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_LOCAL(n) int n __attribute__((unused)) = 0
+#define STATS_INC(n) ((void)0)
+#define STATS_DEPTH(field, n) ((void)0)
+#define STATS_TOKEN(len, off) ((void)0)
+#define STATS_ENTER(prev, p) ((void)0)
+#define STATS_SWITCH(p) ((void)0)
+#define STATS_MERGE() ((void)0)
+#endif
+#endif
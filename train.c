@@ -0,0 +1,533 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : train.c
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ *   Training of the preset dictionaries (see lz77_params) on a directory of
+ *   samples, after the cover algorithm of zstd. A segment of the samples
+ *   scores the # of samples which contain each of its DMER bytes long
+ *   substrings, each one counted once: substrings of a single sample score
+ *   nothing. The samples are split in epochs; the best segment of each
+ *   epoch goes in the dictionary, and its substrings no longer score, until
+ *   the dictionary is full. The segments are placed from its end, the part
+ *   the encoder keeps when the dictionary is larger than the search buffer.
+ *
+ *   A dictionary is made for each segment size of 'segments' and the one
+ *   with which the encoder compresses the samples best is kept. Both the
+ *   counting and the compression are spread over the samples between
+ *   threads.
+ ***************************************************************************/
+
+/***************************************************************************
+ *                             INCLUDED FILES
+ ***************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "bitio.h"
+#include "lz77.h"
+#include "train.h"
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define DMER 8                  /* bytes of the substrings counted, a word */
+#define FREQ_BITS 20            /* log2 of the # of substring counters */
+#define EVAL_SAMPLES 256        /* max # of samples compressed per dictionary */
+
+/* sizes of the segments tried, in bytes */
+static const int segments[] = {64, 256, 1024};
+#define SEGMENT_SIZES ((int)(sizeof(segments) / sizeof(segments[0])))
+
+/***************************************************************************
+ *                            TYPE DEFINITIONS
+ ***************************************************************************/
+struct corpus{
+    unsigned char *data;        /* the samples, one after the other */
+    size_t *start;              /* offset of each sample, then of the end */
+    long count;                 /* # of samples */
+};
+
+/* samples are handed to the counting workers in any order */
+struct countPool{
+    pthread_mutex_t lock;
+    const struct corpus *c;
+    long next;                  /* next sample to count */
+    uint32_t *freq;             /* # of samples with each substring hash */
+    int err;                    /* a worker failed */
+};
+
+/* so are the compressions of the samples with each dictionary */
+struct evalPool{
+    pthread_mutex_t lock;
+    const struct corpus *c;
+    const struct lz77_params *params;  /* encoder parameters of each dictionary */
+    const long *samples;        /* the samples compressed */
+    long nsamples;              /* their # */
+    long next, jobs;            /* next job, # of jobs: dictionary, sample */
+    size_t *sizes;              /* compressed size of each job */
+    int err;                    /* a worker failed */
+};
+
+/* a segment of the samples */
+struct segment{
+    size_t begin, end;          /* offsets of its first and after its last byte */
+    uint64_t score;             /* sum of the counts of its substrings */
+};
+
+/***************************************************************************
+ *                           DMER HASH FUNCTION
+ * Name         : dmerHash - counter of a substring
+ * Parameters   : p - the substring
+ * Returned     : the hash, FREQ_BITS bits
+ ***************************************************************************/
+static inline unsigned int dmerHash(const unsigned char *p)
+{
+    uint64_t v;
+    
+    memcpy(&v, p, DMER);
+    
+    return (v * 0x9E3779B97F4A7C15ULL) >> (64 - FREQ_BITS);
+}
+
+/***************************************************************************
+ *                          RUN WORKERS FUNCTION
+ * Name         : runWorkers - run 'threads' workers on a pool until done
+ * Parameters   : worker - the worker function
+ *                pool - its argument
+ *                threads - # of workers
+ * Returned     : 0 on success, -1 on errors
+ ***************************************************************************/
+static int runWorkers(void *(*worker)(void *), void *pool, int threads)
+{
+    pthread_t *tid;
+    int i, started;
+    
+    if ((tid = malloc(threads * sizeof(pthread_t))) == NULL)
+        return -1;
+    for (started = 0; started < threads; started++)
+        if (pthread_create(&(tid[started]), NULL, worker, pool) != 0)
+            break;
+    /* with no worker at all, the main thread does the job */
+    if (started == 0)
+        worker(pool);
+    for (i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    free(tid);
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                          NAME ORDER FUNCTION
+ * Name         : nameOrder - order of the samples, by file name, so that
+ *                the dictionary doesn't depend on the directory's order
+ ***************************************************************************/
+static int nameOrder(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/***************************************************************************
+ *                          LOAD CORPUS FUNCTION
+ * Name         : loadCorpus - read the regular files of a directory, but
+ *                the hidden and the empty ones
+ * Parameters   : dir - the directory
+ *                c - where the samples go
+ * Returned     : 0 on success, -1 on errors or without samples
+ ***************************************************************************/
+static int loadCorpus(const char *dir, struct corpus *c)
+{
+    DIR *d;
+    struct dirent *ent;
+    struct stat st;
+    FILE *file;
+    char **names = NULL, **tmpNames, *path = NULL;
+    unsigned char *tmp;
+    size_t cap = 0, size = 0, n;
+    long count = 0, nameCap = 0, i, ok = 0;
+    
+    memset(c, 0, sizeof(struct corpus));
+    if ((d = opendir(dir)) == NULL)
+        return -1;
+    while ((ent = readdir(d)) != NULL){
+        if (ent->d_name[0] == '.')
+            continue;
+        if (count == nameCap){
+            nameCap = nameCap ? 2 * nameCap : 256;
+            if ((tmpNames = realloc(names, nameCap * sizeof(char *))) == NULL)
+                goto end;
+            names = tmpNames;
+        }
+        if ((names[count] = strdup(ent->d_name)) == NULL)
+            goto end;
+        count++;
+    }
+    qsort(names, count, sizeof(char *), nameOrder);
+    
+    c->start = malloc((count + 1) * sizeof(size_t));
+    path = malloc(strlen(dir) + NAME_MAX + 2);
+    if (c->start == NULL || path == NULL)
+        goto end;
+    for (i = 0; i < count; i++){
+        sprintf(path, "%s/%s", dir, names[i]);
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+            continue;
+        if ((file = fopen(path, "rb")) == NULL)
+            goto end;
+        if (size + st.st_size > cap){
+            cap = 2 * (size + st.st_size);
+            if ((tmp = realloc(c->data, cap)) == NULL){
+                fclose(file);
+                goto end;
+            }
+            c->data = tmp;
+        }
+        n = fread(&(c->data[size]), 1, st.st_size, file);
+        fclose(file);
+        if (n == 0)
+            continue;
+        c->start[c->count++] = size;
+        size += n;
+    }
+    c->start[c->count] = size;
+    ok = (c->count > 0);
+    
+end:
+    closedir(d);
+    for (i = 0; i < count; i++)
+        free(names[i]);
+    free(names);
+    free(path);
+    if (!ok){
+        free(c->data);
+        free(c->start);
+        memset(c, 0, sizeof(struct corpus));
+        return -1;
+    }
+    
+    return 0;
+}
+
+/***************************************************************************
+ *                         COUNT WORKER FUNCTION
+ * Name         : countWorker - count the substrings of the samples, once
+ *                per sample, then add the counts to the pool's
+ * Parameters   : arg - the pool
+ ***************************************************************************/
+static void *countWorker(void *arg)
+{
+    struct countPool *pool = arg;
+    const struct corpus *c = pool->c;
+    uint32_t *count = calloc(1 << FREQ_BITS, sizeof(uint32_t));
+    uint32_t *seen = calloc(1 << FREQ_BITS, sizeof(uint32_t));
+    unsigned int h;
+    size_t p;
+    long i;
+    
+    if (count == NULL || seen == NULL){
+        pthread_mutex_lock(&pool->lock);
+        pool->err = 1;
+        pthread_mutex_unlock(&pool->lock);
+        free(count);
+        free(seen);
+        return NULL;
+    }
+    
+    while (1){
+        pthread_mutex_lock(&pool->lock);
+        if (pool->next == c->count){
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+    
+        /* 'seen' tells the last sample which had the substring */
+        for (p = c->start[i]; p + DMER <= c->start[i + 1]; p++){
+            h = dmerHash(&(c->data[p]));
+            if (seen[h] != (uint32_t)i + 1){
+                seen[h] = i + 1;
+                count[h]++;
+            }
+        }
+    }
+    
+    pthread_mutex_lock(&pool->lock);
+    for (h = 0; h < 1 << FREQ_BITS; h++)
+        pool->freq[h] += count[h];
+    pthread_mutex_unlock(&pool->lock);
+    free(count);
+    free(seen);
+    
+    return NULL;
+}
+
+/***************************************************************************
+ *                         BEST SEGMENT FUNCTION
+ * Name         : bestSegment - the segment of at most 'k' bytes of a range
+ *                of the samples with the highest score, without the
+ *                substrings which score nothing at its ends
+ * Parameters   : c - the samples
+ *                freq - count of each substring
+ *                active - # of each substring in the window, all 0
+ *                begin, end - the range
+ *                k - segment size
+ * Returned     : the segment
+ ***************************************************************************/
+static struct segment bestSegment(const struct corpus *c, const uint32_t *freq, uint16_t *active, size_t begin, size_t end, int k)
+{
+    struct segment best = {begin, begin, 0};
+    uint64_t score = 0;
+    size_t first = begin, p;
+    unsigned int h;
+    
+    /* the window holds the substrings from 'first' to 'p' */
+    for (p = begin; p + DMER <= end; p++){
+        h = dmerHash(&(c->data[p]));
+        if (active[h]++ == 0)
+            score += freq[h];
+        if (p + DMER - first > (size_t)k){
+            h = dmerHash(&(c->data[first++]));
+            if (--active[h] == 0)
+                score -= freq[h];
+        }
+        if (score > best.score){
+            best.begin = first;
+            best.end = p + DMER;
+            best.score = score;
+        }
+    }
+    for (; first < p; first++)
+        active[dmerHash(&(c->data[first]))]--;
+    
+    if (best.score == 0)
+        return best;
+    while (freq[dmerHash(&(c->data[best.begin]))] == 0)
+        best.begin++;
+    while (freq[dmerHash(&(c->data[best.end - DMER]))] == 0)
+        best.end--;
+    
+    return best;
+}
+
+/***************************************************************************
+ *                          BUILD DICT FUNCTION
+ * Name         : buildDict - fill a dictionary with the best segment of each
+ *                epoch, over and over until it is full or nothing scores
+ * Parameters   : c - the samples
+ *                freq - count of each substring, zeroed as they are taken
+ *                active - # of each substring in a window, all 0
+ *                dict - where the dictionary goes
+ *                size - its size
+ *                k - segment size
+ * Returned     : size of the dictionary
+ ***************************************************************************/
+static size_t buildDict(const struct corpus *c, uint32_t *freq, uint16_t *active, unsigned char *dict, size_t size, int k)
+{
+    size_t total = c->start[c->count], epoch, tail = size, n, p;
+    long epochs, e, idle = 0;
+    struct segment s;
+    
+    epochs = (size / k > 0) ? size / k : 1;
+    if (total / epochs < (size_t)k)
+        epochs = (total / k > 0) ? total / k : 1;
+    epoch = total / epochs;
+    
+    for (e = 0; tail > 0 && idle < epochs; e = (e + 1) % epochs){
+        s = bestSegment(c, freq, active, e * epoch, (e == epochs - 1) ? total : (e + 1) * epoch, k);
+        if (s.score == 0){
+            idle++;
+            continue;
+        }
+        idle = 0;
+    
+        n = (s.end - s.begin < tail) ? s.end - s.begin : tail;
+        tail -= n;
+        memcpy(&(dict[tail]), &(c->data[s.begin]), n);
+        for (p = s.begin; p + DMER <= s.end; p++)
+            freq[dmerHash(&(c->data[p]))] = 0;
+    }
+    memmove(dict, &(dict[tail]), size - tail);
+    
+    return size - tail;
+}
+
+/***************************************************************************
+ *                          EVAL WORKER FUNCTION
+ * Name         : evalWorker - compress samples with the dictionaries
+ * Parameters   : arg - the pool
+ ***************************************************************************/
+static void *evalWorker(void *arg)
+{
+    struct evalPool *pool = arg;
+    const struct corpus *c = pool->c;
+    const struct lz77_params *p;
+    unsigned char *buf = NULL, *tmp;
+    size_t cap = 0, need, len;
+    long j, i;
+    
+    while (1){
+        pthread_mutex_lock(&pool->lock);
+        if (pool->err || pool->next == pool->jobs){
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        j = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+    
+        p = &(pool->params[j / pool->nsamples]);
+        i = pool->samples[j % pool->nsamples];
+        len = c->start[i + 1] - c->start[i];
+        need = lz77_compress_bound(len, p->la, p->sb);
+        if (need > cap){
+            if ((tmp = realloc(buf, need)) == NULL)
+                goto fail;
+            buf = tmp;
+            cap = need;
+        }
+        if ((pool->sizes[j] = lz77_compress_params(&(c->data[c->start[i]]), len, buf, cap, p)) == LZ77_ERROR)
+            goto fail;
+    }
+    free(buf);
+    
+    return NULL;
+    
+fail:
+    pthread_mutex_lock(&pool->lock);
+    pool->err = 1;
+    pthread_mutex_unlock(&pool->lock);
+    free(buf);
+    return NULL;
+}
+
+/***************************************************************************
+ *                          TRAIN DICT FUNCTION
+ * Name         : trainDict - make a preset dictionary out of the samples of
+ *                a directory (see above)
+ * Parameters   : dir - directory of the samples
+ *                dict - where the dictionary goes
+ *                size - its size, at most
+ *                p - encoder parameters the dictionary is for
+ *                threads - # of workers, 0 for one per CPU
+ *                info - where the size of the samples compressed with each
+ *                       dictionary is told, NULL for nowhere
+ * Returned     : size of the dictionary, LZ77_ERROR on errors
+ ***************************************************************************/
+size_t trainDict(const char *dir, unsigned char *dict, size_t size, const struct lz77_params *p, int threads, FILE *info)
+{
+    struct corpus c;
+    struct countPool count;
+    struct evalPool eval;
+    struct lz77_params params[SEGMENT_SIZES + 1];
+    unsigned char *dicts[SEGMENT_SIZES] = {NULL};
+    size_t lens[SEGMENT_SIZES], total[SEGMENT_SIZES + 1], bytes, ret = LZ77_ERROR;
+    uint32_t *freq = NULL, *work = NULL;
+    uint16_t *active = NULL;
+    long *samples = NULL, i, n;
+    int k, best;
+    
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+    if (size == 0 || loadCorpus(dir, &c) < 0)
+        return LZ77_ERROR;
+    
+    /* the substrings of each sample */
+    freq = calloc(1 << FREQ_BITS, sizeof(uint32_t));
+    work = malloc((1 << FREQ_BITS) * sizeof(uint32_t));
+    active = calloc(1 << FREQ_BITS, sizeof(uint16_t));
+    if (freq == NULL || work == NULL || active == NULL)
+        goto end;
+    count.c = &c;
+    count.next = 0;
+    count.freq = freq;
+    count.err = 0;
+    pthread_mutex_init(&count.lock, NULL);
+    n = runWorkers(countWorker, &count, (threads < c.count) ? threads : c.count);
+    pthread_mutex_destroy(&count.lock);
+    if (n < 0 || count.err)
+        goto end;
+    /* what a single sample has is no use to the others */
+    for (i = 0; i < 1 << FREQ_BITS; i++)
+        if (freq[i] < 2)
+            freq[i] = 0;
+    
+    /* a dictionary per segment size, the last one without dictionary */
+    for (k = 0; k <= SEGMENT_SIZES; k++){
+        params[k] = *p;
+        params[k].dict = NULL;
+        params[k].dictLen = 0;
+        if (k == SEGMENT_SIZES)
+            break;
+        if ((dicts[k] = malloc(size)) == NULL)
+            goto end;
+        memcpy(work, freq, (1 << FREQ_BITS) * sizeof(uint32_t));
+        lens[k] = buildDict(&c, work, active, dicts[k], size, segments[k]);
+        params[k].dict = dicts[k];
+        params[k].dictLen = lens[k];
+    }
+    
+    /* compressed by the encoder, on EVAL_SAMPLES samples at most */
+    n = (c.count < EVAL_SAMPLES) ? c.count : EVAL_SAMPLES;
+    if ((samples = malloc(n * sizeof(long))) == NULL)
+        goto end;
+    for (i = 0; i < n; i++)
+        samples[i] = i * c.count / n;
+    eval.c = &c;
+    eval.params = params;
+    eval.samples = samples;
+    eval.nsamples = n;
+    eval.next = 0;
+    eval.jobs = (SEGMENT_SIZES + 1) * n;
+    eval.err = 0;
+    if ((eval.sizes = malloc(eval.jobs * sizeof(size_t))) == NULL)
+        goto end;
+    pthread_mutex_init(&eval.lock, NULL);
+    i = runWorkers(evalWorker, &eval, (threads < eval.jobs) ? threads : eval.jobs);
+    pthread_mutex_destroy(&eval.lock);
+    if (i < 0 || eval.err){
+        free(eval.sizes);
+        goto end;
+    }
+    
+    best = 0;
+    for (k = 0; k <= SEGMENT_SIZES; k++){
+        for (total[k] = 0, i = 0; i < n; i++)
+            total[k] += eval.sizes[k * n + i];
+        if (k < SEGMENT_SIZES && total[k] < total[best])
+            best = k;
+    }
+    free(eval.sizes);
+    
+    if (info != NULL){
+        for (bytes = 0, i = 0; i < n; i++)
+            bytes += c.start[samples[i] + 1] - c.start[samples[i]];
+        fprintf(info, "%ld samples, %zu bytes: %zu bytes compressed without dictionary\n", n, bytes, total[SEGMENT_SIZES]);
+        for (k = 0; k < SEGMENT_SIZES; k++)
+            fprintf(info, "segments of %4d bytes: %zu bytes compressed, dictionary of %zu bytes%s\n",
+                    segments[k], total[k], lens[k], (k == best) ? " (kept)" : "");
+    }
+    memcpy(dict, dicts[best], lens[best]);
+    ret = lens[best];
+    
+end:
+    for (k = 0; k < SEGMENT_SIZES; k++)
+        free(dicts[k]);
+    free(samples);
+    free(freq);
+    free(work);
+    free(active);
+    free(c.data);
+    free(c.start);
+    
+    return ret;
+}
@@ -0,0 +1,14 @@
+/***************************************************************************
+ *          Lempel, Ziv Encoding and Decoding
+ *
+ *   File    : train.h
+ *   Authors : David Costa and Pietro De Rosa
+ *
+ ***************************************************************************/
+#ifndef train_h
+#define train_h
+/***************************************************************************
+ *                         FUNCTIONS DECLARATION
+ ***************************************************************************/
+size_t trainDict(const char *dir, unsigned char *dict, size_t size, const struct lz77_params *p, int threads, FILE *info);
+#endif
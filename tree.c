@@ -10,161 +10,296 @@
  *                             INCLUDED FILES
  ***************************************************************************/
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include "alloc.h"
 #include "tree.h"
+#include "lcp.h"
+#include "stats.h"
+
+/***************************************************************************
+ *                                CONSTANTS
+ ***************************************************************************/
+#define NARROW_MAX (1 << 16)    /* most slots with 16 bits links */
 
 /***************************************************************************
  *                            TYPE DEFINITIONS
- * Nodes are composed by the offset of the sequence in the buffer, length
- * of the sequence, index of its parent in the tree, indices of its children
- * in the tree.
+ * The node of a position is the slot 'off & mask' of the arrays, 'mask + 1'
+ * being a power of two greater than the search buffer size. The window is a
+ * ring of 'wmask + 1' bytes (a power of two) whose first byte is at 'base',
+ * so the sequence is at 'window[(off - base) & wmask]'. Nothing absolute is
+ * kept: as the positions in the tree are the ones of the search buffer, the
+ * position of a slot is the last one mapped on it before the lookahead (see
+ * POS). So scrolling the window, or bringing the positions back, costs
+ * nothing to the tree.
+ * The links are indices of slots, of 16 bits when the slots fit and of 32
+ * otherwise; a link to the node itself stands for none, as a node is never
+ * its own child nor parent. The children, read by every walk, are next to
+ * each other in 'son'; the parents, needed by delete only, are apart.
  ***************************************************************************/
-struct node{
-    int len, off;
-    int parent;
-    int left, right;
+struct searchTree{
+    void *son;                  /* left and right child of each slot */
+    void *parent;               /* parent of each slot */
+    int root;                   /* slot of the root, -1 if empty */
+    unsigned int mask;          /* # of slots minus one */
+    int wide;                   /* 32 bits links */
+    const struct lz77_alloc *alloc; /* where the memory comes from */
 };
 
+/***************************************************************************
+ * The functions below are written once for both the link sizes: 'wide' is
+ * a constant in each of their two copies, so that the accessors compile to
+ * plain loads and stores of the right size. A stored link equal to the
+ * slot itself reads as -1 and -1 is stored as the slot itself. The
+ * accessors use the arrays (and mask) copied in locals by the function,
+ * which the compiler would otherwise load again after every match length.
+ ***************************************************************************/
+#define SPECIALIZED static inline __attribute__((always_inline))
+
+#define LEFT(i) getLink(son, 2 * (i), (i), wide)
+#define RIGHT(i) getLink(son, 2 * (i) + 1, (i), wide)
+#define PARENT(i) getLink(parents, (i), (i), wide)
+#define SET_LEFT(i, v) setLink(son, 2 * (i), (i), (v), wide)
+#define SET_RIGHT(i, v) setLink(son, 2 * (i) + 1, (i), (v), wide)
+#define SET_PARENT(i, v) setLink(parents, (i), (i), (v), wide)
+
+/* absolute position of slot i: the last one mapped on it before 'ref' */
+#define POS(ref, i) ((ref) - (((ref) - (unsigned int)(i)) & mask))
+
+SPECIALIZED int getLink(const void *links, int k, int self, const int wide)
+{
+    int v = wide ? (int)((const uint32_t *)links)[k] : ((const uint16_t *)links)[k];
+    
+    return (v == self) ? -1 : v;
+}
+
+SPECIALIZED void setLink(void *links, int k, int self, int v, const int wide)
+{
+    if (v == -1)
+        v = self;
+    if (wide)
+        ((uint32_t *)links)[k] = v;
+    else
+        ((uint16_t *)links)[k] = v;
+}
+
 /***************************************************************************
  *                          CREATE TREE FUNCTION
- * Name         : createTree - memory allocation for the tree array
- * Parameters   : size - maximum number of nodes in the tree
- * Returned     : pointer to the tree array
+ * Name         : createTree - memory allocation for the tree
+ * Parameters   : size - search buffer size
+ *                a - allocator, NULL for malloc
+ * Returned     : pointer to the tree, NULL if there is no memory
  ***************************************************************************/
-struct node *createTree(int size)
+struct searchTree *createTree(int size, const struct lz77_alloc *a)
 {
-    struct node *tree = calloc(size, sizeof(struct node));
+    unsigned int n = 1;
+    size_t link;
+    struct searchTree *t = memCalloc(a, sizeof(struct searchTree));
+    
+    if (t == NULL)
+        return NULL;
+    /* power of two, greater than the search buffer for POS to be exact */
+    while (n <= (unsigned int)size)
+        n <<= 1;
+    t->wide = (n > NARROW_MAX);
+    link = t->wide ? sizeof(uint32_t) : sizeof(uint16_t);
+    
+    t->alloc = a;
+    t->son = memAlloc(a, 2 * n * link);
+    t->parent = memAlloc(a, n * link);
+    t->root = -1;
+    t->mask = n - 1;
+    if (t->son == NULL || t->parent == NULL){
+        destroyTree(t);
+        return NULL;
+    }
     
-    return tree;
+    return t;
+}
+
+/***************************************************************************
+ *                          RESET TREE FUNCTION
+ * Name         : resetTree - empty the tree, for a new stream: the links of
+ *                a slot are set again when it is inserted
+ * Parameters   : t - pointer to the tree
+ ***************************************************************************/
+void resetTree(struct searchTree *t)
+{
+    t->root = -1;
 }
 
 /***************************************************************************
  *                        DESTROY TREE FUNCTION
- * Name         : destroyTree - memory deallocation of the tree array
- * Parameters   : tree - pointer to the tree array
+ * Name         : destroyTree - memory deallocation of the tree
+ * Parameters   : t - pointer to the tree
  ***************************************************************************/
-void destroyTree(struct node *tree)
+void destroyTree(struct searchTree *t)
 {
-    free(tree);
+    memFree(t->alloc, t->son);
+    memFree(t->alloc, t->parent);
+    memFree(t->alloc, t);
 }
 
 /***************************************************************************
  *                            INSERT FUNCTION
  * Name         : insert - insert a node in the tree
- * Parameters   : tree - pointer to the binary tree array
- *                root - index of the root in the array
- *                window - pointer to the buffer
- *                abs_off - absolute offset of the sequence
+ * Parameters   : t - pointer to the tree
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                base - position of window[0]
+ *                abs_off - absolute position of the sequence
  *                len - length of the sequence
- *                max - size of the tree array
+ *                wide - 32 bits links
  ***************************************************************************/
-void insert(struct node *tree, int *root, unsigned char *window, int abs_off, int len, int max)
+SPECIALIZED void insertLinks(struct searchTree *t, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int abs_off, int len, const int wide)
 {
     /* variables */
-    int i, tmp;
-    int off = abs_off % max;    /* from absolute index to relative index (array) */
+    int i, tmp, n;
+    void *son = t->son, *parents = t->parent;
+    unsigned int mask = t->mask;
+    int off = abs_off & mask;       /* from absolute position to slot */
+    unsigned char *seq = &(window[(abs_off - base) & wmask]), *node;
+    STATS_LOCAL(depth);
     
     /* no root: the new node becomes the root */
-    if (*root == -1){
-        *root = off;
-        tree[*root].parent = -1;
+    if (t->root == -1){
+        t->root = off;
+        SET_PARENT(off, -1);
     }else{
-        i = *root;
-        
+        i = t->root;
+    
         while (1){
             tmp = i;
-            if (memcmp(&(window[abs_off]), &(window[tree[i].off]), len) < 0){
+            STATS_INC(depth);
+            /* the first mismatch gives the order, as memcmp would */
+            node = &(window[(POS(abs_off, i) - base) & wmask]);
+            n = matchLength(seq, node, len);
+            STATS_ADD(cmpBytes, n);
+            if (n < len && seq[n] < node[n]){
                 /* go to the left child */
-                i = tree[i].left;
+                i = LEFT(i);
                 if (i == -1){
                     /* set parent-child relation */
-                    tree[tmp].left = off;
-                    tree[off].parent = tmp;
-                    
+                    SET_LEFT(tmp, off);
+                    SET_PARENT(off, tmp);
+    
                     break;
                 }
             }else{
                 /* go to the right child */
-                i = tree[i].right;
+                i = RIGHT(i);
                 if (i == -1){
                     /* set parent-child relation */
-                    tree[tmp].right = off;
-                    tree[off].parent = tmp;
-                
+                    SET_RIGHT(tmp, off);
+                    SET_PARENT(off, tmp);
+    
                     break;
                 }
             }
         }
     }
     
+    STATS_DEPTH(insert, depth);
+    
     /* set other parameters */
-    tree[off].off = abs_off;
-    tree[off].len = len;
-    tree[off].left = -1;
-    tree[off].right = -1;
+    SET_LEFT(off, -1);
+    SET_RIGHT(off, -1);
+}
+
+void insert(struct searchTree *t, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int abs_off, int len)
+{
+    if (t->wide)
+        insertLinks(t, window, wmask, base, abs_off, len, 1);
+    else
+        insertLinks(t, window, wmask, base, abs_off, len, 0);
 }
 
 /***************************************************************************
  *                            FIND FUNCTION
  * Name         : find - find the longest match in the tree
- * Parameters   : tree - pointer to the binary tree array
- *                root - index of the root in the array
- *                window - pointer to the buffer
- *                index - starting index of the lookahead
+ * Parameters   : t - pointer to the tree
+ *                window - pointer to the ring buffer
+ *                wmask - size of the ring buffer minus one
+ *                base - position of window[0]
+ *                index - absolute position of the lookahead
  *                size - actual lookahead size
+ *                wide - 32 bits links
  * Returned     : best match's offset and length
  ***************************************************************************/
-struct ret find(struct node *tree, int root, unsigned char *window, int index, int size)
+SPECIALIZED struct ret findLinks(struct searchTree *t, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int index, int size, const int wide)
 {
     /* variables */
-    int i, j;
+    int i, j, next;
+    void *son = t->son;
+    unsigned int dist, mask = t->mask;
     struct ret off_len;
+    unsigned char *la = &(window[(index - base) & wmask]), *seq;
+    STATS_LOCAL(depth);
     
     /* initialize as non-match values */
     off_len.off = 0;
     off_len.len = 0;
     
-    if (root == -1)
+    if (t->root == -1)
         return off_len;
-    j = root;
+    j = t->root;
     
     /* flow the tree finding the longest match node */
     while (1){
-        
+    
+        dist = (index - j) & mask;
+        seq = &(window[(index - dist - base) & wmask]);
+    
         /* look for how many characters are equal between the lookahead and the node */
-        for (i = 0; window[index+i] == window[tree[j].off + i] && i < size-1; i++){}
-        
+        i = matchLength(la, seq, size-1);
+        STATS_INC(depth);
+        STATS_ADD(cmpBytes, i + 1);
+    
         /* if the new match is better than the previous one, save the values */
         if (i > off_len.len){
-            off_len.off = index - tree[j].off;
+            off_len.off = dist;
             off_len.len = i;
         }
-        
-        if (window[index+i] < window[tree[j].off + i] && tree[j].left != -1)
-            j = tree[j].left;
-        else if (window[index+i] > window[tree[j].off + i] && tree[j].right != -1)
-            j = tree[j].right;
+    
+        if (la[i] < seq[i])
+            next = LEFT(j);
+        else if (la[i] > seq[i])
+            next = RIGHT(j);
         else break;
+        if (next == -1)
+            break;
+        j = next;
     }
+    STATS_DEPTH(find, depth);
     
     return off_len;
 }
 
+struct ret find(struct searchTree *t, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int index, int size)
+{
+    if (t->wide)
+        return findLinks(t, window, wmask, base, index, size, 1);
+    
+    return findLinks(t, window, wmask, base, index, size, 0);
+}
+
 /***************************************************************************
  *                           MINIMUM CHILD FUNCTION
  * Name         : minChild - find the minimum node in the tree and return
  *                its index, used whether a node to be deleted has both the
  *                children
- * Parameters   : tree - pointer to the binary tree
- *                elem - node to be deleted
+ * Parameters   : t - pointer to the tree
+ *                index - root of the subtree
+ *                wide - 32 bits links
  ***************************************************************************/
-int minChild(struct node *tree, int index)
+SPECIALIZED int minChild(struct searchTree *t, int index, const int wide)
 {
+    void *son = t->son;
     int min = index;
     
-    while (tree[min].left != -1)
-        min = tree[min].left;
+    while (LEFT(min) != -1)
+        min = LEFT(min);
     
     return min;
 }
@@ -173,107 +308,106 @@ int minChild(struct node *tree, int index)
  *                            DELETE FUNCTION
  * Name         : delete - delete the node from the tree in the specific
  *                offset
- * Parameters   : tree - pointer to the binary tree
- *                root - index of the root of the binary tree
- *                window - pointer to the buffer
- *                abs_sb - actual starting index of the search buffer
- *                max - size of the tree array
+ * Parameters   : t - pointer to the tree
+ *                abs_sb - absolute position of the search buffer's start
+ *                wide - 32 bits links
  ***************************************************************************/
-void delete(struct node *tree, int *root, unsigned char *window, int abs_sb, int max)
+SPECIALIZED void deleteLinks(struct searchTree *t, unsigned int abs_sb, const int wide)
 {
     /* variables */
     int parent, child, sb;
+    void *son = t->son, *parents = t->parent;
     
-    sb = abs_sb % max;  /* from absolute index to relative index (array) */
+    sb = abs_sb & t->mask;      /* from absolute position to slot */
+    STATS_ADD(deletes, 1);
     
-    if (tree[sb].left == -1){
+    if (LEFT(sb) == -1){
         /* the node to be deleted has not the left child */
-        child = tree[sb].right;
+        child = RIGHT(sb);
         if (child != -1)
-            tree[child].parent = tree[sb].parent;
-        parent = tree[sb].parent;
-
-    }else if (tree[sb].right == -1){
+            SET_PARENT(child, PARENT(sb));
+        parent = PARENT(sb);
+    
+    }else if (RIGHT(sb) == -1){
         /* the node to be deleted has not the right child */
-        child = tree[sb].left;
-        tree[child].parent = tree[sb].parent;
-        parent = tree[sb].parent;
-        
+        child = LEFT(sb);
+        SET_PARENT(child, PARENT(sb));
+        parent = PARENT(sb);
+    
     }else{
         /* the node to be deleted has both the children: it will be replaced
            by the minimum child of its right subtree */
-        child = minChild(tree, tree[sb].right);
-        
-        if (tree[child].parent == sb){
+        STATS_ADD(deletes2, 1);
+        child = minChild(t, RIGHT(sb), wide);
+    
+        if (PARENT(child) == sb){
             /* just the left child has to be updated */
-            parent = tree[sb].parent;
-            tree[child].parent = parent;
-            
+            parent = PARENT(sb);
+            SET_PARENT(child, parent);
+    
         }else{
             /* also the right child has to be updated */
-            parent = tree[child].parent;
-            tree[parent].left = tree[child].right;
-            if(tree[child].right != -1)
-                tree[tree[child].right].parent = parent;
-        
-            tree[child].right = tree[sb].right;
-            tree[child].parent = tree[sb].parent;
-        
-            if (tree[child].right != -1)
-                tree[tree[child].right].parent = child;
-        
-            parent = tree[child].parent;
+            parent = PARENT(child);
+            SET_LEFT(parent, RIGHT(child));
+            if (RIGHT(child) != -1)
+                SET_PARENT(RIGHT(child), parent);
+    
+            SET_RIGHT(child, RIGHT(sb));
+            SET_PARENT(child, PARENT(sb));
+    
+            if (RIGHT(child) != -1)
+                SET_PARENT(RIGHT(child), child);
+    
+            parent = PARENT(child);
         }
-        
-        tree[child].left = tree[sb].left;
-        if (tree[child].left != -1)
-            tree[tree[child].left].parent = child;
+    
+        SET_LEFT(child, LEFT(sb));
+        if (LEFT(child) != -1)
+            SET_PARENT(LEFT(child), child);
     }
     
     /* set the parent's child or the child as the root */
     if (parent != -1){
-        if (tree[parent].right == sb){
-            tree[parent].right = child;
+        if (RIGHT(parent) == sb){
+            SET_RIGHT(parent, child);
         }else{
-            tree[parent].left = child;
+            SET_LEFT(parent, child);
         }
     }else
-        *root = child;
+        t->root = child;
     
 }
 
-/***************************************************************************
- *                         UPDATE OFFSET FUNCTION
- * Name         : updateOffset - update the offset when the buffer is shifted
- * Parameters   : tree - binary tree
- *                n - value to subtract
- *                max - length of the array
- ***************************************************************************/
-void updateOffset(struct node *tree, int n, int max)
+void delete(struct searchTree *t, unsigned int abs_sb)
 {
-    int i;
-    
-    for (i = 0; i < max; i++){
-        if (tree[i].off != -1)
-            tree[i].off -= n;
-    }
+    if (t->wide)
+        deleteLinks(t, abs_sb, 1);
+    else
+        deleteLinks(t, abs_sb, 0);
 }
 
 /***************************************************************************
  *                           PRINT TREE FUNCTION
  * Name         : printtree - print the whole tree in increasing order
- * Parameters   : tree - binary tree
- *                root - node's index
+ * Parameters   : t - pointer to the tree
+ *                index - absolute position of the lookahead
  * Just for debug
  ***************************************************************************/
-void printtree(struct node *tree, int root)
+static void printNode(struct searchTree *t, int root, unsigned int index)
 {
+    void *son = t->son;
+    unsigned int mask = t->mask;
+    const int wide = t->wide;
+    
     if (root == -1)
         return;
     
-    if (tree[root].left != -1)
-        printtree(tree, tree[root].left);
-    printf("%d\n", tree[root].off);
-    if (tree[root].right != -1)
-        printtree(tree, tree[root].right);
+    printNode(t, LEFT(root), index);
+    printf("%u\n", POS(index, root));
+    printNode(t, RIGHT(root), index);
+}
+
+void printtree(struct searchTree *t, unsigned int index)
+{
+    printNode(t, t->root, index);
 }
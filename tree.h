@@ -10,20 +10,53 @@
 /***************************************************************************
  *                            TYPE DEFINITIONS
  ***************************************************************************/
-struct node;
+struct searchTree;
+struct lz77_alloc;
 
 struct ret{
     int off, len;
 };
 
+/* the matches met by a find that are longer than the ones met before it,
+   the last MATCHES_MAX of them: the longest is the last one, the shorter
+   ones are nearer (and cheaper to code) */
+#define MATCHES_MAX 4
+struct matches{
+    int n;
+    struct ret m[MATCHES_MAX];
+};
+
+/***************************************************************************
+ *                           ADD MATCH FUNCTION
+ * Name         : addMatch - append a longer match, dropping the shortest one
+ *                if there are already MATCHES_MAX of them
+ * Parameters   : all - the matches, NULL if they are not wanted
+ *                off - offset of the match
+ *                len - its length
+ ***************************************************************************/
+static inline void addMatch(struct matches *all, int off, int len)
+{
+    int i;
+    
+    if (all == NULL)
+        return;
+    if (all->n == MATCHES_MAX){
+        for (i = 1; i < MATCHES_MAX; i++)
+            all->m[i - 1] = all->m[i];
+        all->n--;
+    }
+    all->m[all->n].off = off;
+    all->m[all->n++].len = len;
+}
+
 /***************************************************************************
  *                         FUNCTIONS DECLARATION
  ***************************************************************************/
-struct node *createTree(int size);
-void destroyTree(struct node *tree);
-void insert(struct node *tree, int *root, unsigned char *window, int off, int len, int max);
-struct ret find(struct node *tree, int root, unsigned char *window, int index, int size);
-void delete(struct node *tree, int *root, unsigned char *window, int abs_sb, int max);
-void updateOffset(struct node *tree, int n, int max);
-void printtree(struct node *tree, int root);
+struct searchTree *createTree(int size, const struct lz77_alloc *a);
+void resetTree(struct searchTree *t);
+void destroyTree(struct searchTree *t);
+void insert(struct searchTree *t, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int off, int len);
+struct ret find(struct searchTree *t, unsigned char *window, unsigned int wmask, unsigned int base, unsigned int index, int size);
+void delete(struct searchTree *t, unsigned int abs_sb);
+void printtree(struct searchTree *t, unsigned int index);
 #endif